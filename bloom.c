@@ -0,0 +1,217 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "bloom.h"
+#include "hash.h"
+#include "mapfile.h"
+
+/*  About 10 bits per key and 6 bits set per key give a false positive
+ * rate a little over 1%. */
+#define YMP_CONFIG_BLOOM_BITS_PER_KEY 10
+#define BLOOM_BITS_SET 6
+
+#define BLOOM_BLOCK_WORDS 8     /* 8 * 64 bits, one cache line */
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_WORDS * 64)
+
+#define BLOOM_MAGIC "YMPBLOOM"
+#define BLOOM_VERSION 1
+
+/*  The file is this header followed by the blocks, in the byte order of
+ * the host that built the cache it sits next to. */
+typedef struct {
+    char magic[8];
+    guint32 version;
+    guint32 n_blocks;
+    guint64 n_keys;
+    guint64 checksum;   /* yum_hash_fnv1a () of the blocks */
+} BloomHeader;
+
+struct _YumBloom {
+    guint64 *blocks;
+    guint32 n_blocks;
+    guint64 n_keys;
+
+    /* Set when the blocks are mapped from a file */
+    const char *map;
+    gsize map_size;
+};
+
+GQuark
+yum_bloom_error_quark (void)
+{
+    static GQuark quark;
+
+    if (!quark)
+        quark = g_quark_from_static_string ("yum_bloom_error");
+
+    return quark;
+}
+
+/*  The block of key and, in bits, the BLOOM_BITS_SET 9 bit positions
+ * inside it. */
+static guint64 *
+bloom_block (YumBloom *bloom, const char *key, gsize len, guint64 *bits)
+{
+    guint64 h;
+    guint64 block;
+
+    h = yum_hash_name (key, len);
+    block = ((h >> 32) * bloom->n_blocks) >> 32;
+    *bits = yum_hash_mix (h);
+
+    return bloom->blocks + block * BLOOM_BLOCK_WORDS;
+}
+
+YumBloom *
+yum_bloom_new (guint64 n_keys)
+{
+    YumBloom *bloom;
+    guint64 n_blocks;
+
+    n_blocks = (n_keys * YMP_CONFIG_BLOOM_BITS_PER_KEY + BLOOM_BLOCK_BITS - 1)
+        / BLOOM_BLOCK_BITS;
+
+    bloom = g_new0 (YumBloom, 1);
+    bloom->n_blocks = MAX (n_blocks, 1);
+    bloom->blocks = g_new0 (guint64, bloom->n_blocks * BLOOM_BLOCK_WORDS);
+
+    return bloom;
+}
+
+void
+yum_bloom_add (YumBloom *bloom, const char *key, gsize len)
+{
+    guint64 *block;
+    guint64 bits;
+    guint bit;
+    int i;
+
+    block = bloom_block (bloom, key, len, &bits);
+    for (i = 0; i < BLOOM_BITS_SET; i++, bits >>= 9) {
+        bit = bits & (BLOOM_BLOCK_BITS - 1);
+        block[bit / 64] |= G_GUINT64_CONSTANT (1) << (bit % 64);
+    }
+
+    bloom->n_keys++;
+}
+
+/* FALSE only when key was never added */
+gboolean
+yum_bloom_may_contain (YumBloom *bloom, const char *key, gsize len)
+{
+    guint64 *block;
+    guint64 bits;
+    guint bit;
+    int i;
+
+    block = bloom_block (bloom, key, len, &bits);
+    for (i = 0; i < BLOOM_BITS_SET; i++, bits >>= 9) {
+        bit = bits & (BLOOM_BLOCK_BITS - 1);
+        if (!(block[bit / 64] & (G_GUINT64_CONSTANT (1) << (bit % 64))))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+void
+yum_bloom_write (YumBloom *bloom, const char *path, GError **err)
+{
+    BloomHeader header;
+    gsize size;
+    FILE *f;
+
+    size = (gsize) bloom->n_blocks * BLOOM_BLOCK_WORDS * sizeof (guint64);
+
+    memset (&header, 0, sizeof (header));
+    memcpy (header.magic, BLOOM_MAGIC, sizeof (header.magic));
+    header.version = BLOOM_VERSION;
+    header.n_blocks = bloom->n_blocks;
+    header.n_keys = bloom->n_keys;
+    header.checksum = yum_hash_fnv1a (bloom->blocks, size);
+
+    f = fopen (path, "w");
+    if (!f) {
+        g_set_error (err, YUM_BLOOM_ERROR, YUM_BLOOM_ERROR,
+                     "Can not create %s: %s", path, strerror (errno));
+        return;
+    }
+
+    if (fwrite (&header, sizeof (header), 1, f) != 1 ||
+        fwrite (bloom->blocks, size, 1, f) != 1) {
+        g_set_error (err, YUM_BLOOM_ERROR, YUM_BLOOM_ERROR,
+                     "Can not write %s: %s", path, strerror (errno));
+        fclose (f);
+        return;
+    }
+
+    if (fclose (f) != 0)
+        g_set_error (err, YUM_BLOOM_ERROR, YUM_BLOOM_ERROR,
+                     "Can not write %s: %s", path, strerror (errno));
+}
+
+/*  Maps the filter yum_bloom_write () left in path. The file is checked
+ * whole once here, a damaged filter could answer "not here" wrongly. */
+YumBloom *
+yum_bloom_open (const char *path, GError **err)
+{
+    YumBloom *bloom;
+    const BloomHeader *header;
+    const char *map;
+    gsize map_size;
+    gsize size;
+
+    map = yum_map_file (path, BLOOM_MAGIC, BLOOM_VERSION,
+                        sizeof (BloomHeader), "filter",
+                        YUM_BLOOM_ERROR, &map_size, err);
+    if (!map)
+        return NULL;
+
+    header = (const BloomHeader *) map;
+    size = (gsize) header->n_blocks * BLOOM_BLOCK_WORDS * sizeof (guint64);
+    if (header->n_blocks == 0 || map_size != sizeof (BloomHeader) + size ||
+        yum_hash_fnv1a (map + sizeof (BloomHeader), size) !=
+        header->checksum) {
+        g_set_error (err, YUM_BLOOM_ERROR, YUM_BLOOM_ERROR,
+                     "Can not read %s: not a valid filter", path);
+        yum_unmap_file (map, map_size);
+        return NULL;
+    }
+
+    bloom = g_new0 (YumBloom, 1);
+    bloom->blocks = (guint64 *) (map + sizeof (BloomHeader));
+    bloom->n_blocks = header->n_blocks;
+    bloom->n_keys = header->n_keys;
+    bloom->map = map;
+    bloom->map_size = map_size;
+
+    return bloom;
+}
+
+void
+yum_bloom_free (YumBloom *bloom)
+{
+    if (bloom->map)
+        yum_unmap_file (bloom->map, bloom->map_size);
+    else
+        g_free (bloom->blocks);
+
+    g_free (bloom);
+}
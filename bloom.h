@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __YUM_BLOOM_H__
+#define __YUM_BLOOM_H__
+
+#include <glib.h>
+
+#define YUM_BLOOM_ERROR yum_bloom_error_quark()
+GQuark yum_bloom_error_quark (void);
+
+/*  A blocked Bloom filter: every key sets a few bits of one 64 byte block,
+ * so a lookup reads a single cache line. Built in memory with
+ * yum_bloom_new (), read back from its file with yum_bloom_open (). */
+typedef struct _YumBloom YumBloom;
+
+YumBloom *yum_bloom_new          (guint64 n_keys);
+void      yum_bloom_add          (YumBloom *bloom,
+                                  const char *key,
+                                  gsize len);
+void      yum_bloom_write        (YumBloom *bloom,
+                                  const char *path,
+                                  GError **err);
+
+YumBloom *yum_bloom_open         (const char *path, GError **err);
+gboolean  yum_bloom_may_contain  (YumBloom *bloom,
+                                  const char *key,
+                                  gsize len);
+void      yum_bloom_free         (YumBloom *bloom);
+
+#endif /* __YUM_BLOOM_H__ */
@@ -15,15 +15,30 @@
  * 02111-1307, USA.
  */
 
+#define _GNU_SOURCE     /* memrchr () */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include "db.h"
+#include "bloom.h"
+#include "hashindex.h"
+#include "evr.h"
+#include "filenames.h"
+#include "hash.h"
+#include "ymp-sqlite.h"
 
 /*  We have a lot of code so we can "quickly" update the .sqlite file using
  * the old .sqlite data and the new .xml data. However it seems to have weird
  * edge cases where it doesn't work, rhbz 465898 etc. ... so we turn it off. */
 #define YMP_CONFIG_UPDATE_DB 0
 
+/*  Metadata up to this size uncompressed gets its .sqlite built in memory
+ * and written out in one go, larger files are built on disk. */
+#define YMP_CONFIG_MEMORY_LIMIT (128 * 1024 * 1024)
+
 GQuark
 yum_db_error_quark (void)
 {
@@ -38,7 +53,11 @@ yum_db_error_quark (void)
 #define ENCODED_PACKAGE_FILE_FILES 2048
 #define ENCODED_PACKAGE_FILE_TYPES 60
 
+/* The files of a package in one directory, as a filelist row */
 typedef struct {
+    const char *dir;    /* Points into a PackageFile name, not terminated */
+    int dir_len;
+    guint hash;
     GString *files;
     GString *types;
 } EncodedPackageFile;
@@ -63,49 +82,220 @@ encoded_package_file_free (EncodedPackageFile *file)
     g_free (file);
 }
 
-static GHashTable *
-package_files_to_hash (GSList *files)
+#define FILES_ENCODER_SLOTS 64
+
+typedef struct {
+    guint generation;   /* Empty unless it is the encoder's */
+    guint dir;          /* Index into FilesEncoder.dirs */
+} FilesEncoderSlot;
+
+/*  Groups the files of a package by directory. Everything is kept from one
+ * package to the next, so after the first few packages grouping a file
+ * list does not allocate: the slots of an open addressing table over the
+ * directories are emptied by bumping generation, the EncodedPackageFiles
+ * are truncated. */
+typedef struct {
+    FilesEncoderSlot *slots;
+    guint n_slots;      /* A power of two, at least twice n_dirs */
+    guint generation;
+    GPtrArray *dirs;    /* EncodedPackageFile, the first n_dirs in use */
+    guint n_dirs;
+} FilesEncoder;
+
+static FilesEncoder *
+files_encoder_new (void)
 {
-    GHashTable *hash;
-    GSList *iter;
-    PackageFile *file;
-    EncodedPackageFile *enc;
-    char *dir;
-    char *name;
+    FilesEncoder *enc;
 
-    hash = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                  (GDestroyNotify) g_free,
-                                  (GDestroyNotify) encoded_package_file_free);
+    enc = g_new0 (FilesEncoder, 1);
+    enc->n_slots = FILES_ENCODER_SLOTS;
+    enc->slots = g_new0 (FilesEncoderSlot, enc->n_slots);
+    enc->generation = 1;
+    enc->dirs = g_ptr_array_new ();
 
-    for (iter = files; iter; iter = iter->next) {
-        file = (PackageFile *) iter->data;
+    return enc;
+}
 
-        dir = g_path_get_dirname (file->name);
-        name = g_path_get_basename (file->name);
+static void
+files_encoder_free (FilesEncoder *enc)
+{
+    g_ptr_array_foreach (enc->dirs, (GFunc) encoded_package_file_free, NULL);
+    g_ptr_array_free (enc->dirs, TRUE);
+    g_free (enc->slots);
+    g_free (enc);
+}
 
-        enc = (EncodedPackageFile *) g_hash_table_lookup (hash, dir);
-        if (!enc) {
-            enc = encoded_package_file_new ();
-            g_hash_table_insert (hash, dir, enc);
-        } else
-            g_free (dir);
+/* Start over with the next package */
+static void
+files_encoder_reset (FilesEncoder *enc)
+{
+    enc->n_dirs = 0;
+    if (++enc->generation == 0) {
+        memset (enc->slots, 0, enc->n_slots * sizeof (FilesEncoderSlot));
+        enc->generation = 1;
+    }
+}
 
-        if (enc->files->len)
-            g_string_append_c (enc->files, '/');
-        g_string_append (enc->files, name);
-        g_free (name);
+static guint
+files_encoder_hash (const char *dir, int len)
+{
+    guint hash = 5381;
+    int i;
 
-        if (!strcmp (file->type, "dir"))
-            g_string_append_c (enc->types, 'd');
-        else if (!strcmp (file->type, "file"))
-            g_string_append_c (enc->types, 'f');
-        else if (!strcmp (file->type, "ghost"))
-            g_string_append_c (enc->types, 'g');
-    }
+    for (i = 0; i < len; i++)
+        hash = (hash << 5) + hash + (guchar) dir[i];
 
     return hash;
 }
 
+static void
+files_encoder_grow (FilesEncoder *enc)
+{
+    EncodedPackageFile *file;
+    guint mask;
+    guint i, j;
+
+    g_free (enc->slots);
+    enc->n_slots *= 2;
+    enc->slots = g_new0 (FilesEncoderSlot, enc->n_slots);
+
+    mask = enc->n_slots - 1;
+    for (i = 0; i < enc->n_dirs; i++) {
+        file = g_ptr_array_index (enc->dirs, i);
+        for (j = file->hash & mask; enc->slots[j].generation == enc->generation;
+             j = (j + 1) & mask)
+            ;
+        enc->slots[j].generation = enc->generation;
+        enc->slots[j].dir = i;
+    }
+}
+
+/* The group of directory dir, a new one if it has none yet */
+static EncodedPackageFile *
+files_encoder_lookup (FilesEncoder *enc, const char *dir, int len)
+{
+    EncodedPackageFile *file;
+    guint hash;
+    guint mask;
+    guint i;
+
+    hash = files_encoder_hash (dir, len);
+    mask = enc->n_slots - 1;
+
+    for (i = hash & mask; enc->slots[i].generation == enc->generation;
+         i = (i + 1) & mask) {
+        file = g_ptr_array_index (enc->dirs, enc->slots[i].dir);
+        if (file->hash == hash && file->dir_len == len &&
+            !memcmp (file->dir, dir, len))
+            return file;
+    }
+
+    if (enc->n_dirs == enc->dirs->len)
+        g_ptr_array_add (enc->dirs, encoded_package_file_new ());
+
+    file = g_ptr_array_index (enc->dirs, enc->n_dirs);
+    file->dir = dir;
+    file->dir_len = len;
+    file->hash = hash;
+    g_string_truncate (file->files, 0);
+    g_string_truncate (file->types, 0);
+
+    enc->slots[i].generation = enc->generation;
+    enc->slots[i].dir = enc->n_dirs++;
+
+    if (enc->n_dirs * 2 > enc->n_slots)
+        files_encoder_grow (enc);
+
+    return file;
+}
+
+/*  Splits name in place the way g_path_get_dirname () and
+ * g_path_get_basename () would, without copying either part. */
+static void
+split_path (const char *name,
+            const char **dir, int *dir_len,
+            const char **base, int *base_len)
+{
+    const char *slash;
+    int len;
+
+    len = strlen (name);
+    slash = memrchr (name, '/', len);
+
+    if (!slash) {
+        *dir = ".";
+        *dir_len = 1;
+    } else {
+        const char *end = slash;
+
+        while (end > name && end[-1] == '/')
+            end--;
+        *dir = name;
+        *dir_len = end > name ? end - name : 1;
+    }
+
+    /* The basename ignores trailing slashes, the dirname does not */
+    if (slash && slash == name + len - 1) {
+        while (len > 1 && name[len - 1] == '/')
+            len--;
+        slash = len > 1 ? memrchr (name, '/', len) : NULL;
+    }
+
+    if (len == 0) {
+        *base = ".";
+        *base_len = 1;
+    } else if (!slash) {
+        *base = name;
+        *base_len = len;
+    } else {
+        *base = slash + 1;
+        *base_len = name + len - *base;
+    }
+}
+
+/* The filetypes letter of a file type, 0 for types filelist ignores */
+static char
+file_type_char (const char *type)
+{
+    if (!strcmp (type, "dir"))
+        return 'd';
+    else if (!strcmp (type, "file"))
+        return 'f';
+    else if (!strcmp (type, "ghost"))
+        return 'g';
+
+    return 0;
+}
+
+static void
+files_encoder_add (FilesEncoder *enc, PackageFile *file)
+{
+    EncodedPackageFile *group;
+    const char *dir;
+    const char *base;
+    int dir_len;
+    int base_len;
+    char type;
+
+    split_path (file->name, &dir, &dir_len, &base, &base_len);
+    group = files_encoder_lookup (enc, dir, dir_len);
+
+    if (group->files->len)
+        g_string_append_c (group->files, '/');
+    g_string_append_len (group->files, base, base_len);
+
+    type = file_type_char (file->type);
+    if (type)
+        g_string_append_c (group->types, type);
+}
+
+void
+yum_db_options_init (YumDbOptions *options)
+{
+    memset (options, 0, sizeof (YumDbOptions));
+    options->memory_limit = YMP_CONFIG_MEMORY_LIMIT;
+}
+
 char *
 yum_db_filename (const char *prefix)
 {
@@ -177,21 +367,58 @@ yum_db_create_dbinfo_table (sqlite3 *db, GError **err)
     }
 }
 
+/*  The mode of the cache replacing path: the old one's, else what
+ * creating it would have given it under the umask, not g_mkstemp ()'s
+ * 0600. */
+static mode_t
+build_mode (const char *path)
+{
+    struct stat buf;
+    mode_t mask;
+
+    if (stat (path, &buf) == 0)
+        return buf.st_mode & 0777;
+
+    mask = umask (0);
+    umask (mask);
+
+    return 0666 & ~mask;
+}
+
+/* Makes a rename () into the directory of path survive a crash */
+static void
+sync_dir (const char *path)
+{
+    char *dir;
+    int fd;
+
+    dir = g_path_get_dirname (path);
+    fd = open (dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync (fd);
+        close (fd);
+    }
+    g_free (dir);
+}
+
 sqlite3 *
 yum_db_open (const char *path,
              const char *checksum,
              CreateTablesFn create_tables,
+             const YumDbOptions *options,
+             gboolean in_memory,
+             char **build_path,
              GError **err)
 {
     int rc;
+    int fd;
     sqlite3 *db = NULL;
-    gboolean db_existed;
 
-    db_existed = g_file_test (path, G_FILE_TEST_EXISTS);
+    *build_path = NULL;
 
-    rc = sqlite3_open (path, &db);
-    if (rc == SQLITE_OK) {
-        if (db_existed) {
+    if (g_file_test (path, G_FILE_TEST_EXISTS)) {
+        rc = sqlite3_open (path, &db);
+        if (rc == SQLITE_OK) {
             DBStatus status = dbinfo_status (db, checksum);
 
             switch (status) {
@@ -204,55 +431,153 @@ yum_db_open (const char *path,
                 if (YMP_CONFIG_UPDATE_DB) {
                     sqlite3_exec (db, "PRAGMA synchronous = 0", NULL,NULL,NULL);
                     sqlite3_exec (db, "DELETE FROM db_info", NULL, NULL, NULL);
+                    yum_db_register_functions (db);
                     return db;
                     break;
                 }
                 /* FALL THROUGH */
             case DB_STATUS_VERSION_MISMATCH:
             case DB_STATUS_ERROR:
-                sqlite3_close (db);
-                db = NULL;
-                unlink (path);
                 break;
             }
         }
-    } else {
-        /* Let's try to delete it and try again,
-           maybe it's a sqlite3 version mismatch. */
+
+        /* Either stale or unreadable (maybe a sqlite3 version mismatch),
+           it gets replaced once the new one is complete. */
         sqlite3_close (db);
         db = NULL;
-        unlink (path);
     }
 
-    if (!db) {
-        rc = sqlite3_open (path, &db);
-        if (rc != SQLITE_OK) {
-            g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                         "Can not open SQL database: %s",
-                         sqlite3_errmsg (db));
-            goto cleanup;
-        }
+    /*  Build into a scratch file next to the real one and rename() it into
+     * place when done, so readers never see a half-built cache and anyone
+     * still holding the old one open keeps reading the old inode. */
+    *build_path = g_strconcat (path, ".XXXXXX", NULL);
+    fd = g_mkstemp (*build_path);
+    if (fd < 0) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create %s: %s", *build_path,
+                     g_strerror (errno));
+        g_free (*build_path);
+        *build_path = NULL;
+        goto cleanup;
+    }
+    fchmod (fd, build_mode (path));
+    close (fd);
+
+    /* In memory builds are copied to build_path by yum_db_close() */
+    rc = sqlite3_open (in_memory ? ":memory:" : *build_path, &db);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not open SQL database: %s",
+                     sqlite3_errmsg (db));
+        goto cleanup;
     }
 
+    /* The file is thrown away on failure, no need for a journal */
+    sqlite3_exec (db, "PRAGMA journal_mode = OFF", NULL, NULL, NULL);
+    sqlite3_exec (db, "PRAGMA synchronous = 0", NULL, NULL, NULL);
+
+    /*  For the views and the post-load stages of some layouts. Registering
+     * a function again expires the statements prepared so far, it is done
+     * once, before there are any. */
+    yum_db_register_functions (db);
+
     yum_db_create_dbinfo_table (db, err);
     if (*err)
         goto cleanup;
 
-    create_tables (db, err);
+    create_tables (db, options, err);
     if (*err)
         goto cleanup;
 
-    sqlite3_exec (db, "PRAGMA synchronous = 0", NULL, NULL, NULL);
-
  cleanup:
     if (*err && db) {
         sqlite3_close (db);
         db = NULL;
     }
 
+    if (*err && *build_path) {
+        unlink (*build_path);
+        g_free (*build_path);
+        *build_path = NULL;
+    }
+
     return db;
 }
 
+static void
+yum_db_save (sqlite3 *db, const char *path, GError **err)
+{
+    int rc;
+    sqlite3 *dest = NULL;
+    sqlite3_backup *backup;
+
+    rc = sqlite3_open (path, &dest);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not open SQL database: %s",
+                     sqlite3_errmsg (dest));
+        goto cleanup;
+    }
+
+    sqlite3_exec (dest, "PRAGMA journal_mode = OFF", NULL, NULL, NULL);
+    sqlite3_exec (dest, "PRAGMA synchronous = 0", NULL, NULL, NULL);
+
+    backup = sqlite3_backup_init (dest, "main", db, "main");
+    if (backup) {
+        sqlite3_backup_step (backup, -1);
+        sqlite3_backup_finish (backup);
+    }
+
+    rc = sqlite3_errcode (dest);
+    if (rc != SQLITE_OK)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not write %s: %s", path, sqlite3_errmsg (dest));
+
+ cleanup:
+    sqlite3_close (dest);
+}
+
+void
+yum_db_close (sqlite3 *db,
+              const char *path,
+              const char *build_path,
+              GError **err)
+{
+    const char *filename;
+    int fd;
+
+    filename = sqlite3_db_filename (db, "main");
+    if (build_path && !*err && (!filename || !*filename))
+        yum_db_save (db, build_path, err);
+
+    sqlite3_close (db);
+
+    if (!build_path)
+        return;
+
+    if (*err) {
+        unlink (build_path);
+        return;
+    }
+
+    fd = open (build_path, O_RDONLY);
+    if (fd >= 0) {
+        fsync (fd);
+        close (fd);
+    }
+
+    if (rename (build_path, path) < 0) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not rename %s to %s: %s", build_path, path,
+                     g_strerror (errno));
+        unlink (build_path);
+        return;
+    }
+
+    sync_dir (path);
+}
+
 void
 yum_db_dbinfo_update (sqlite3 *db, const char *checksum, GError **err)
 {
@@ -314,210 +639,2689 @@ yum_db_read_package_ids (sqlite3 *db, GError **err)
     return hash;
 }
 
-void
-yum_db_create_primary_tables (sqlite3 *db, GError **err)
+/*  Tables holding per-package rows, cleaned up when a package goes away.
+ * Tables of optional layouts are skipped when db does not have them. */
+const char *
+yum_db_primary_package_tables[YUM_DB_N_PRIMARY_PACKAGE_TABLES + 1] = {
+    "requires", "provides", "conflicts", "obsoletes", "files", NULL
+};
+static const char *filelist_package_tables[] = {
+    "filelist", "filepaths", NULL
+};
+static const char *other_package_tables[] = { "changelog", NULL };
+
+/* How a packages column can be stored, see YumDbOptions */
+typedef enum {
+    COLUMN_PLAIN,
+    COLUMN_DIGEST,      /* Raw bytes with compact_types */
+    COLUMN_TYPE,        /* Dictionary with compact_types */
+    COLUMN_STRING       /* Dictionary with dictionary_columns */
+} ColumnEncoding;
+
+typedef struct {
+    const char *name;
+    const char *type;
+    ColumnEncoding encoding;
+} PackageColumn;
+
+/*  The packages columns after pkgKey, in the order the writers bind them.
+ * A dictionary encoded column <name> is stored as <name>_id, referring to
+ * the (id, name) table <name>s. */
+static const PackageColumn package_columns[] = {
+    { "pkgId",              "TEXT",     COLUMN_DIGEST },
+    { "name",               "TEXT",     COLUMN_PLAIN },
+    { "arch",               "TEXT",     COLUMN_PLAIN },
+    { "version",            "TEXT",     COLUMN_PLAIN },
+    { "epoch",              "TEXT",     COLUMN_PLAIN },
+    { "release",            "TEXT",     COLUMN_PLAIN },
+    { "summary",            "TEXT",     COLUMN_PLAIN },
+    { "description",        "TEXT",     COLUMN_PLAIN },
+    { "url",                "TEXT",     COLUMN_STRING },
+    { "time_file",          "INTEGER",  COLUMN_PLAIN },
+    { "time_build",         "INTEGER",  COLUMN_PLAIN },
+    { "rpm_license",        "TEXT",     COLUMN_STRING },
+    { "rpm_vendor",         "TEXT",     COLUMN_STRING },
+    { "rpm_group",          "TEXT",     COLUMN_STRING },
+    { "rpm_buildhost",      "TEXT",     COLUMN_STRING },
+    { "rpm_sourcerpm",      "TEXT",     COLUMN_PLAIN },
+    { "rpm_header_start",   "INTEGER",  COLUMN_PLAIN },
+    { "rpm_header_end",     "INTEGER",  COLUMN_PLAIN },
+    { "rpm_packager",       "TEXT",     COLUMN_STRING },
+    { "size_package",       "INTEGER",  COLUMN_PLAIN },
+    { "size_installed",     "INTEGER",  COLUMN_PLAIN },
+    { "size_archive",       "INTEGER",  COLUMN_PLAIN },
+    { "location_href",      "TEXT",     COLUMN_PLAIN },
+    { "location_base",      "TEXT",     COLUMN_STRING },
+    { "checksum_type",      "TEXT",     COLUMN_TYPE }
+};
+#define N_PACKAGE_COLUMNS G_N_ELEMENTS (package_columns)
+
+static gboolean
+yum_db_table_exists (sqlite3 *db, const char *table)
 {
+    sqlite3_stmt *handle = NULL;
+    gboolean exists = FALSE;
     int rc;
-    const char *sql;
-
-    sql =
-        "CREATE TABLE packages ("
-        "  pkgKey INTEGER PRIMARY KEY,"
-        "  pkgId TEXT,"
-        "  name TEXT,"
-        "  arch TEXT,"
-        "  version TEXT,"
-        "  epoch TEXT,"
-        "  release TEXT,"
-        "  summary TEXT,"
-        "  description TEXT,"
-        "  url TEXT,"
-        "  time_file INTEGER,"
-        "  time_build INTEGER,"
-        "  rpm_license TEXT,"
-        "  rpm_vendor TEXT,"
-        "  rpm_group TEXT,"
-        "  rpm_buildhost TEXT,"
-        "  rpm_sourcerpm TEXT,"
-        "  rpm_header_start INTEGER,"
-        "  rpm_header_end INTEGER,"
-        "  rpm_packager TEXT,"
-        "  size_package INTEGER,"
-        "  size_installed INTEGER,"
-        "  size_archive INTEGER,"
-        "  location_href TEXT,"
-        "  location_base TEXT,"
-        "  checksum_type TEXT)";
-
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create packages table: %s",
-                     sqlite3_errmsg (db));
-        return;
-    }
 
-    sql =
-        "CREATE TABLE files ("
-        "  name TEXT,"
-        "  type TEXT,"
-        "  pkgKey INTEGER)";
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create files table: %s",
-                     sqlite3_errmsg (db));
-        return;
+    rc = sqlite3_prepare (db, "SELECT 1 FROM sqlite_master"
+                          "  WHERE type = 'table' AND name = ?",
+                          -1, &handle, NULL);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_text (handle, 1, table, -1, SQLITE_STATIC);
+        exists = sqlite3_step (handle) == SQLITE_ROW;
     }
+    sqlite3_finalize (handle);
 
-    sql =
-        "CREATE TABLE %s ("
-        "  name TEXT,"
-        "  flags TEXT,"
-        "  epoch TEXT,"
-        "  version TEXT,"
-        "  release TEXT,"
-        "  pkgKey INTEGER %s)";
+    return exists;
+}
 
-    const char *deps[] = { "requires", "provides", "conflicts", "obsoletes", NULL };
-    int i;
+/* Whether db was created with YumDbOptions.normalize_deps */
+static gboolean
+yum_db_has_depnames (sqlite3 *db)
+{
+    return yum_db_table_exists (db, "depnames");
+}
 
-    for (i = 0; deps[i]; i++) {
-        const char *prereq;
-        char *query;
+/*  The declared type of filelist filenames in the front_code_files layout,
+ * which is how yum_db_layout_open () tells it and whether to compress
+ * apart. Both are BLOBs to SQLite. */
+#define FILENAMES_FRONT_CODED "BLOB"
+#define FILENAMES_COMPRESSED  "ZSTD_BLOB"
 
-        if (!strcmp(deps[i], "requires")) {
-            prereq = ", pre BOOLEAN DEFAULT FALSE";
-        } else
-            prereq = "";
+/* The declared type of column in table, NULL if there is no such column */
+static char *
+yum_db_column_type (sqlite3 *db, const char *table, const char *column)
+{
+    sqlite3_stmt *handle = NULL;
+    char *query;
+    char *type = NULL;
+    int rc;
 
-        query = g_strdup_printf (sql, deps[i], prereq);
-        rc = sqlite3_exec (db, query, NULL, NULL, NULL);
-        g_free (query);
+    query = g_strdup_printf ("PRAGMA table_info (%s)", table);
+    rc = sqlite3_prepare (db, query, -1, &handle, NULL);
+    g_free (query);
+    if (rc == SQLITE_OK) {
+        while (!type && sqlite3_step (handle) == SQLITE_ROW) {
+            const char *name = (const char *) sqlite3_column_text (handle, 1);
 
-        if (rc != SQLITE_OK) {
-            g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                         "Can not create %s table: %s",
-                         deps[i], sqlite3_errmsg (db));
-            return;
+            if (!strcmp (name, column))
+                type = g_strdup ((const char *) sqlite3_column_text (handle,
+                                                                     2));
         }
     }
+    sqlite3_finalize (handle);
 
-    sql =
-        "CREATE TRIGGER removals AFTER DELETE ON packages"
-        "  BEGIN"
-        "    DELETE FROM files WHERE pkgKey = old.pkgKey;"
-        "    DELETE FROM requires WHERE pkgKey = old.pkgKey;"
-        "    DELETE FROM provides WHERE pkgKey = old.pkgKey;"
-        "    DELETE FROM conflicts WHERE pkgKey = old.pkgKey;"
-        "    DELETE FROM obsoletes WHERE pkgKey = old.pkgKey;"
-        "  END;";
+    return type;
+}
 
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create removals trigger: %s",
-                     sqlite3_errmsg (db));
-        return;
+/*  Whether db was created with YumDbOptions.compact_types, which makes
+ * pkgId a BLOB column. */
+static gboolean
+yum_db_is_compact (sqlite3 *db)
+{
+    char *type;
+    gboolean compact;
+
+    type = yum_db_column_type (db, "packages_data", "pkgId");
+    compact = type && !strcmp (type, "BLOB");
+    g_free (type);
+
+    return compact;
+}
+
+/*  Some layouts keep a table's rows in <table>_data, behind a view with
+ * the table's name. Returns the real table, to be freed by the caller. */
+static char *
+table_for (sqlite3 *db, const char *table)
+{
+    char *data;
+
+    data = g_strconcat (table, "_data", NULL);
+    if (yum_db_table_exists (db, data))
+        return data;
+
+    g_free (data);
+    return g_strdup (table);
+}
+
+static char *
+removal_trigger_sql (sqlite3 *db, const char *trigger, const char **tables)
+{
+    GString *sql;
+    char *table;
+    int i;
+
+    table = table_for (db, "packages");
+    sql = g_string_new (NULL);
+    g_string_append_printf (sql, "CREATE TRIGGER IF NOT EXISTS %s"
+                            "  AFTER DELETE ON %s"
+                            "  BEGIN", trigger, table);
+    g_free (table);
+
+    for (i = 0; tables[i]; i++) {
+        table = table_for (db, tables[i]);
+        if (yum_db_table_exists (db, table))
+            g_string_append_printf (sql, "    DELETE FROM %s"
+                                    " WHERE pkgKey = old.pkgKey;", table);
+        g_free (table);
     }
+    g_string_append (sql, "  END;");
+
+    return g_string_free (sql, FALSE);
 }
 
-void
-yum_db_index_primary_tables (sqlite3 *db, GError **err)
+static void
+yum_db_create_removal_trigger (sqlite3 *db,
+                               const char *trigger,
+                               const char **tables,
+                               GError **err)
 {
     int rc;
-    const char *sql;
+    char *sql;
 
-    sql = "CREATE INDEX IF NOT EXISTS packagename ON packages (name)";
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create packagename index: %s",
-                     sqlite3_errmsg (db));
-        return;
-    }
-    
-    sql = "CREATE INDEX IF NOT EXISTS packageId ON packages (pkgId)";
+    sql = removal_trigger_sql (db, trigger, tables);
     rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
+    g_free (sql);
+
+    if (rc != SQLITE_OK)
         g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create packageId index: %s",
-                     sqlite3_errmsg (db));
-        return;
-    }
+                     "Can not create %s trigger: %s",
+                     trigger, sqlite3_errmsg (db));
+}
+
+sqlite3_stmt *
+yum_db_stale_packages_prepare (sqlite3 *db, GError **err)
+{
+    int rc;
+    sqlite3_stmt *handle = NULL;
+    const char *sql;
 
-    sql = "CREATE INDEX IF NOT EXISTS filenames ON files (name)";
+    sql = "CREATE TEMP TABLE IF NOT EXISTS stale_packages ("
+        "  pkgKey INTEGER PRIMARY KEY)";
     rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
     if (rc != SQLITE_OK) {
         g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create filenames index: %s",
+                     "Can not create stale_packages table: %s",
                      sqlite3_errmsg (db));
-        return;
+        return NULL;
     }
 
-    sql = "CREATE INDEX IF NOT EXISTS pkgfiles ON files (pkgKey)";
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    sql = "INSERT OR IGNORE INTO stale_packages (pkgKey) VALUES (?)";
+    rc = sqlite3_prepare (db, sql, -1, &handle, NULL);
     if (rc != SQLITE_OK) {
         g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create index on files table: %s",
+                     "Can not prepare stale package insertion: %s",
                      sqlite3_errmsg (db));
-        return;
+        sqlite3_finalize (handle);
+        handle = NULL;
     }
 
-    const char *deps[] = { "requires", "provides", "conflicts", "obsoletes", NULL };
+    return handle;
+}
+
+void
+yum_db_stale_package_write (sqlite3 *db, sqlite3_stmt *handle, gint64 pkgKey)
+{
+    int rc;
+
+    sqlite3_bind_int64 (handle, 1, pkgKey);
+    rc = sqlite3_step (handle);
+    sqlite3_reset (handle);
+
+    if (rc != SQLITE_DONE)
+        g_critical ("Error marking package as stale: %s",
+                    sqlite3_errmsg (db));
+}
+
+/*  Delete every package listed in stale_packages with one statement per
+ * table. The removal trigger would otherwise run its child DELETEs once per
+ * package, so it is dropped for the duration and put back afterwards. */
+static void
+yum_db_remove_stale_packages (sqlite3 *db,
+                              const char *trigger,
+                              const char **tables,
+                              GError **err)
+{
+    int rc;
     int i;
+    char *sql;
+    char *table;
 
-    const char *pkgindexsql = "CREATE INDEX IF NOT EXISTS pkg%s on %s (pkgKey)";
-    const char *nameindexsql = "CREATE INDEX IF NOT EXISTS %sname ON %s (name)";
+    sql = g_strdup_printf ("DROP TRIGGER IF EXISTS %s", trigger);
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    g_free (sql);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not drop %s trigger: %s",
+                     trigger, sqlite3_errmsg (db));
+        return;
+    }
 
-    for (i = 0; deps[i]; i++) {
-        char *query;
+    for (i = 0; tables[i]; i++) {
+        table = table_for (db, tables[i]);
+        if (!yum_db_table_exists (db, table)) {
+            g_free (table);
+            continue;
+        }
 
-        query = g_strdup_printf(pkgindexsql, deps[i], deps[i]);
-        rc = sqlite3_exec (db, query, NULL, NULL, NULL);
-        g_free (query);
+        sql = g_strdup_printf ("DELETE FROM %s WHERE pkgKey IN "
+                               "(SELECT pkgKey FROM stale_packages)", table);
+        rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+        g_free (sql);
+        g_free (table);
 
         if (rc != SQLITE_OK) {
             g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                         "Can not remove stale packages from %s: %s",
+                         tables[i], sqlite3_errmsg (db));
+            return;
+        }
+    }
+
+    table = table_for (db, "packages");
+    sql = g_strdup_printf ("DELETE FROM %s WHERE pkgKey IN "
+                           "(SELECT pkgKey FROM stale_packages)", table);
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    g_free (sql);
+    g_free (table);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not remove stale packages: %s",
+                     sqlite3_errmsg (db));
+        return;
+    }
+
+    yum_db_create_removal_trigger (db, trigger, tables, err);
+    if (*err)
+        return;
+
+    sqlite3_exec (db, "DELETE FROM stale_packages", NULL, NULL, NULL);
+}
+
+/* Drop the names no package refers to any more from the packages columns */
+static void
+yum_db_remove_unused_package_names (sqlite3 *db, GError **err)
+{
+    const char *name;
+    char *table;
+    char *sql;
+    int rc;
+    guint i;
+
+    for (i = 0; i < N_PACKAGE_COLUMNS && !*err; i++) {
+        name = package_columns[i].name;
+        table = g_strconcat (name, "s", NULL);
+
+        if ((package_columns[i].encoding == COLUMN_TYPE ||
+             package_columns[i].encoding == COLUMN_STRING) &&
+            yum_db_table_exists (db, table)) {
+            sql = g_strdup_printf ("DELETE FROM %s WHERE id NOT IN"
+                                   "  (SELECT %s_id FROM packages_data)",
+                                   table, name);
+            rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+            g_free (sql);
+
+            if (rc != SQLITE_OK)
+                g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                             "Can not remove unused %s names: %s",
+                             name, sqlite3_errmsg (db));
+        }
+
+        g_free (table);
+    }
+}
+
+void
+yum_db_remove_primary_packages (sqlite3 *db, GError **err)
+{
+    const char *sql;
+    int rc;
+
+    yum_db_remove_stale_packages (db, "removals",
+                                  yum_db_primary_package_tables, err);
+    if (*err)
+        return;
+
+    yum_db_remove_unused_package_names (db, err);
+    if (*err || !yum_db_has_depnames (db))
+        return;
+
+    sql =
+        "DELETE FROM depnames WHERE id NOT IN ("
+        "  SELECT name_id FROM requires_data UNION"
+        "  SELECT name_id FROM provides_data UNION"
+        "  SELECT name_id FROM conflicts_data UNION"
+        "  SELECT name_id FROM obsoletes_data)";
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not remove unused dependency names: %s",
+                     sqlite3_errmsg (db));
+}
+
+void
+yum_db_remove_filelist_packages (sqlite3 *db, GError **err)
+{
+    yum_db_remove_stale_packages (db, "remove_filelist",
+                                  filelist_package_tables, err);
+}
+
+void
+yum_db_remove_other_packages (sqlite3 *db, GError **err)
+{
+    yum_db_remove_stale_packages (db, "remove_changelogs",
+                                  other_package_tables, err);
+}
+
+/*  Rows for the big child tables are queued up and inserted
+ * YUM_DB_BATCH_ROWS at a time with a single multi-row INSERT, which saves a
+ * VM run per row. Queued strings are copied into one reused buffer, the
+ * packages they come from are gone long before the batch is full. */
+#define YUM_DB_BATCH_ROWS 64
+#define YUM_DB_BATCH_STRINGS 16384
+
+/* SQLITE_MAX_VARIABLE_NUMBER of the sqlite versions we still run on */
+#define YUM_DB_BATCH_PARAMS 999
+
+/*  A sorted batch holds on to its rows until flushed, or until they take up
+ * this much memory, and writes them out ordered by its key column. Big
+ * repositories end up as a few sorted runs instead of one. */
+#define YUM_DB_SORT_RUN_BYTES (64 * 1024 * 1024)
+
+/*  A started batch hands its rows to a thread of its own, in chunks of
+ * YUM_DB_CHUNK_STMTS statements worth of rows. There are only
+ * YUM_DB_WORKER_CHUNKS chunks per batch, a parser that gets ahead of the
+ * writer waits for one to come back instead of piling up rows. */
+#define YUM_DB_CHUNK_STMTS 16
+#define YUM_DB_WORKER_CHUNKS 4
+
+/* In the order SQLite sorts values of different storage classes */
+typedef enum {
+    BATCH_NULL,
+    BATCH_INT,
+    BATCH_TEXT,
+    BATCH_BLOB
+} BatchValueType;
+
+typedef struct {
+    BatchValueType type;
+    gint64 num;     /* BATCH_INT value or BATCH_TEXT/BLOB offset in strings */
+    int len;
+} BatchValue;
+
+typedef struct {
+    BatchValue *values;
+    int n_values;
+    int max_values;
+    GString *strings;
+} BatchChunk;
+
+/* Queued after the last chunk to stop a worker */
+static BatchChunk batch_end;
+
+struct _YumDbBatch {
+    sqlite3 *db;
+    char *table;
+    char *columns;
+    int n_columns;
+    int rows_per_stmt;
+    int sort_column;    /* -1 if the rows have no useful order */
+    gboolean sorted;
+    YumDbLayout *layout;    /* Set for the layouts that need it */
+    FilesEncoder *files;    /* yum_db_filelists_write () scratch */
+    sqlite3_stmt *handle;
+    BatchValue *values;
+    int n_values;
+    int max_values;
+    GString *strings;
+    gint64 rows;
+    gdouble seconds;
+    GTimer *timer;
+
+    /* Worker thread, see yum_db_batch_start () */
+    gboolean threaded;
+    GThread *thread;
+    GAsyncQueue *full_chunks;
+    GAsyncQueue *free_chunks;
+    BatchChunk chunks[YUM_DB_WORKER_CHUNKS - 1];
+    BatchChunk run;         /* Rows of a sorted batch the worker holds */
+    char **index_sql;
+    char *error;
+};
+
+static sqlite3_stmt *
+batch_prepare (YumDbBatch *batch, int n_rows, GError **err)
+{
+    GString *sql;
+    sqlite3_stmt *handle = NULL;
+    int rc;
+    int i, j;
+
+    sql = g_string_sized_new (64 + n_rows * batch->n_columns * 2);
+    g_string_append_printf (sql, "INSERT INTO %s (%s) VALUES ",
+                            batch->table, batch->columns);
+    for (i = 0; i < n_rows; i++) {
+        g_string_append (sql, i ? ", (?" : "(?");
+        for (j = 1; j < batch->n_columns; j++)
+            g_string_append (sql, ", ?");
+        g_string_append_c (sql, ')');
+    }
+
+    rc = sqlite3_prepare (batch->db, sql->str, sql->len, &handle, NULL);
+    g_string_free (sql, TRUE);
+
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not prepare %s insertion: %s",
+                     batch->table, sqlite3_errmsg (batch->db));
+        sqlite3_finalize (handle);
+        handle = NULL;
+    }
+
+    return handle;
+}
+
+static YumDbBatch *
+yum_db_batch_new (sqlite3 *db,
+                  const char *table,
+                  const char *columns,
+                  int n_columns,
+                  int sort_column,
+                  GError **err)
+{
+    YumDbBatch *batch;
+
+    batch = g_new0 (YumDbBatch, 1);
+    batch->db = db;
+    batch->table = g_strdup (table);
+    batch->columns = g_strdup (columns);
+    batch->n_columns = n_columns;
+    batch->rows_per_stmt = MIN (YUM_DB_BATCH_ROWS,
+                                YUM_DB_BATCH_PARAMS / n_columns);
+    batch->sort_column = sort_column;
+
+    batch->handle = batch_prepare (batch, batch->rows_per_stmt, err);
+    if (*err) {
+        yum_db_batch_free (batch);
+        return NULL;
+    }
+
+    batch->max_values = batch->rows_per_stmt * n_columns;
+    batch->values = g_new0 (BatchValue, batch->max_values);
+    batch->strings = g_string_sized_new (YUM_DB_BATCH_STRINGS);
+    batch->timer = g_timer_new ();
+
+    return batch;
+}
+
+static void
+batch_bind_row (YumDbBatch *batch,
+                sqlite3_stmt *handle,
+                int slot,
+                BatchValue *value,
+                const char *strings)
+{
+    int param;
+    int i;
+
+    param = slot * batch->n_columns + 1;
+
+    for (i = 0; i < batch->n_columns; i++, value++, param++) {
+        switch (value->type) {
+        case BATCH_TEXT:
+            sqlite3_bind_text (handle, param, strings + value->num,
+                               value->len, SQLITE_STATIC);
+            break;
+        case BATCH_INT:
+            sqlite3_bind_int64 (handle, param, value->num);
+            break;
+        case BATCH_BLOB:
+            sqlite3_bind_blob (handle, param, strings + value->num,
+                               value->len, SQLITE_STATIC);
+            break;
+        case BATCH_NULL:
+            sqlite3_bind_null (handle, param);
+            break;
+        }
+    }
+}
+
+static void
+batch_step (YumDbBatch *batch, sqlite3_stmt *handle, int n_rows)
+{
+    int rc;
+
+    g_timer_start (batch->timer);
+    rc = sqlite3_step (handle);
+    sqlite3_reset (handle);
+    batch->seconds += g_timer_elapsed (batch->timer, NULL);
+
+    if (rc == SQLITE_DONE)
+        batch->rows += n_rows;
+    else if (batch->threaded) {
+        /* No logging off the main thread, yum_db_batch_join () reports it */
+        if (!batch->error)
+            batch->error = g_strdup_printf ("Error adding rows to %s: %s",
+                                            batch->table,
+                                            sqlite3_errmsg (batch->db));
+    } else
+        g_critical ("Error adding rows to %s: %s",
+                    batch->table, sqlite3_errmsg (batch->db));
+}
+
+static void
+batch_clear (YumDbBatch *batch)
+{
+    batch->n_values = 0;
+    g_string_truncate (batch->strings, 0);
+}
+
+static void
+batch_run (YumDbBatch *batch, sqlite3_stmt *handle)
+{
+    int n_rows = batch->n_values / batch->n_columns;
+    int i;
+
+    for (i = 0; i < n_rows; i++)
+        batch_bind_row (batch, handle, i, &batch->values[i * batch->n_columns],
+                        batch->strings->str);
+
+    batch_step (batch, handle, n_rows);
+    batch_clear (batch);
+}
+
+static void
+batch_text_len (YumDbBatch *batch, const char *text, int len)
+{
+    BatchValue *value = &batch->values[batch->n_values++];
+
+    if (!text) {
+        value->type = BATCH_NULL;
+        return;
+    }
+
+    value->type = BATCH_TEXT;
+    value->num = batch->strings->len;
+    value->len = len;
+    g_string_append_len (batch->strings, text, len);
+}
+
+static void
+batch_text (YumDbBatch *batch, const char *text)
+{
+    batch_text_len (batch, text, text ? strlen (text) : 0);
+}
+
+static void
+batch_int (YumDbBatch *batch, gint64 num)
+{
+    BatchValue *value = &batch->values[batch->n_values++];
+
+    value->type = BATCH_INT;
+    value->num = num;
+}
+
+static void
+batch_blob (YumDbBatch *batch, const guchar *data, int len)
+{
+    batch_text_len (batch, (const char *) data, len);
+    batch->values[batch->n_values - 1].type = BATCH_BLOB;
+}
+
+/* Insert n_rows rows from values, in the given order if there is one */
+static void
+batch_write_rows (YumDbBatch *batch,
+                  BatchValue *values,
+                  const char *strings,
+                  const int *order,
+                  int n_rows,
+                  GError **err)
+{
+    sqlite3_stmt *handle;
+    int chunk;
+    int row;
+    int i, j;
+
+    for (i = 0; i < n_rows; i += chunk) {
+        chunk = MIN (batch->rows_per_stmt, n_rows - i);
+        if (chunk == batch->rows_per_stmt)
+            handle = batch->handle;
+        else {
+            handle = batch_prepare (batch, chunk, err);
+            if (*err)
+                return;
+        }
+
+        for (j = 0; j < chunk; j++) {
+            row = order ? order[i + j] : i + j;
+            batch_bind_row (batch, handle, j, &values[row * batch->n_columns],
+                            strings);
+        }
+        batch_step (batch, handle, chunk);
+
+        if (handle != batch->handle)
+            sqlite3_finalize (handle);
+    }
+}
+
+/* The rows batch_row_cmp () orders */
+typedef struct {
+    YumDbBatch *batch;
+    BatchValue *values;
+    const char *strings;
+} BatchSort;
+
+static gint
+batch_row_cmp (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    BatchSort *sort = (BatchSort *) user_data;
+    YumDbBatch *batch = sort->batch;
+    int row_a = *(const int *) a;
+    int row_b = *(const int *) b;
+    BatchValue *va = &sort->values[row_a * batch->n_columns +
+                                   batch->sort_column];
+    BatchValue *vb = &sort->values[row_b * batch->n_columns +
+                                   batch->sort_column];
+    int cmp;
+
+    /*  Same order as the indexes: by storage class, then integers by
+     * value and text and blobs bytewise as the BINARY collation does, a
+     * prefix before the longer string. */
+    if (va->type != vb->type)
+        return va->type - vb->type;
+
+    if (va->type == BATCH_TEXT || va->type == BATCH_BLOB) {
+        cmp = memcmp (sort->strings + va->num, sort->strings + vb->num,
+                      MIN (va->len, vb->len));
+        if (cmp == 0)
+            cmp = va->len - vb->len;
+    } else
+        cmp = (va->num > vb->num) - (va->num < vb->num);
+
+    /* Keep document order between equal keys */
+    return cmp ? cmp : row_a - row_b;
+}
+
+/* Insert n_rows rows from values ordered by the batch's key column */
+static void
+batch_write_sorted (YumDbBatch *batch,
+                    BatchValue *values,
+                    const char *strings,
+                    int n_rows,
+                    GError **err)
+{
+    BatchSort sort = { batch, values, strings };
+    int *order;
+    int i;
+
+    order = g_new (int, n_rows);
+    for (i = 0; i < n_rows; i++)
+        order[i] = i;
+
+    g_qsort_with_data (order, n_rows, sizeof (int), batch_row_cmp, &sort);
+    batch_write_rows (batch, values, strings, order, n_rows, err);
+
+    g_free (order);
+}
+
+static void
+batch_run_sorted (YumDbBatch *batch, GError **err)
+{
+    batch_write_sorted (batch, batch->values, batch->strings->str,
+                        batch->n_values / batch->n_columns, err);
+    batch_clear (batch);
+}
+
+/*  The worker's batch_run_sorted (): writes out the rows of a sorted
+ * batch it holds, after the last chunk or once they take up
+ * YUM_DB_SORT_RUN_BYTES. */
+static void
+batch_worker_run_sorted (YumDbBatch *batch, GError **err)
+{
+    BatchChunk *run = &batch->run;
+
+    batch_write_sorted (batch, run->values, run->strings->str,
+                        run->n_values / batch->n_columns, err);
+    run->n_values = 0;
+    g_string_truncate (run->strings, 0);
+}
+
+/* Adds the rows of chunk to the worker's run, see above */
+static void
+batch_worker_add_chunk (YumDbBatch *batch, BatchChunk *chunk, GError **err)
+{
+    BatchChunk *run = &batch->run;
+    gsize offset = run->strings->len;
+    BatchValue *value;
+    gsize size;
+    int i;
+
+    if (run->n_values + chunk->n_values > run->max_values) {
+        run->max_values = MAX (run->max_values * 2,
+                               run->n_values + chunk->n_values);
+        run->values = g_renew (BatchValue, run->values, run->max_values);
+    }
+
+    value = &run->values[run->n_values];
+    memcpy (value, chunk->values, chunk->n_values * sizeof (BatchValue));
+    for (i = 0; i < chunk->n_values; i++, value++) {
+        if (value->type == BATCH_TEXT || value->type == BATCH_BLOB)
+            value->num += offset;
+    }
+    run->n_values += chunk->n_values;
+    g_string_append_len (run->strings, chunk->strings->str,
+                         chunk->strings->len);
+
+    size = run->strings->len + run->n_values * sizeof (BatchValue);
+    if (size >= YUM_DB_SORT_RUN_BYTES)
+        batch_worker_run_sorted (batch, err);
+}
+
+/* Queue the rows gathered so far for the worker and start a new chunk */
+static void
+batch_hand_off (YumDbBatch *batch)
+{
+    BatchChunk *chunk;
+    BatchValue *values;
+    GString *strings;
+
+    chunk = g_async_queue_pop (batch->free_chunks);
+
+    values = chunk->values;
+    strings = chunk->strings;
+
+    chunk->values = batch->values;
+    chunk->n_values = batch->n_values;
+    chunk->strings = batch->strings;
+
+    batch->values = values;
+    batch->strings = strings;
+    batch->n_values = 0;
+
+    g_async_queue_push (batch->full_chunks, chunk);
+}
+
+static gpointer
+batch_worker (gpointer user_data)
+{
+    YumDbBatch *batch = (YumDbBatch *) user_data;
+    BatchChunk *chunk;
+    GError *err = NULL;
+    int i;
+
+    /* All the rows go in as one transaction, like the parser's */
+    sqlite3_exec (batch->db, "BEGIN", NULL, NULL, NULL);
+
+    while ((chunk = g_async_queue_pop (batch->full_chunks)) != &batch_end) {
+        /* Keep taking chunks after a failure, the parser waits for them */
+        if (!err && batch->sorted)
+            batch_worker_add_chunk (batch, chunk, &err);
+        else if (!err)
+            batch_write_rows (batch, chunk->values, chunk->strings->str, NULL,
+                              chunk->n_values / batch->n_columns, &err);
+
+        chunk->n_values = 0;
+        g_string_truncate (chunk->strings, 0);
+        g_async_queue_push (batch->free_chunks, chunk);
+    }
+
+    if (!err && batch->sorted)
+        batch_worker_run_sorted (batch, &err);
+
+    if (!err && sqlite3_exec (batch->db, "COMMIT",
+                              NULL, NULL, NULL) != SQLITE_OK)
+        g_set_error (&err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not write %s table: %s",
+                     batch->table, sqlite3_errmsg (batch->db));
+    if (err)
+        sqlite3_exec (batch->db, "ROLLBACK", NULL, NULL, NULL);
+
+    for (i = 0; !err && batch->index_sql[i]; i++) {
+        if (sqlite3_exec (batch->db, batch->index_sql[i],
+                          NULL, NULL, NULL) != SQLITE_OK)
+            g_set_error (&err, YUM_DB_ERROR, YUM_DB_ERROR,
                          "Can not create index on %s table: %s",
-                         deps[i], sqlite3_errmsg (db));
+                         batch->table, sqlite3_errmsg (batch->db));
+    }
+
+    if (err) {
+        if (!batch->error)
+            batch->error = g_strdup (err->message);
+        g_error_free (err);
+    }
+
+    return NULL;
+}
+
+static void
+batch_row_done (YumDbBatch *batch)
+{
+    GError *err = NULL;
+    gsize size;
+
+    if (batch->threaded) {
+        if (batch->n_values == batch->max_values)
+            batch_hand_off (batch);
+        return;
+    }
+
+    if (!batch->sorted) {
+        if (batch->n_values == batch->rows_per_stmt * batch->n_columns)
+            batch_run (batch, batch->handle);
+        return;
+    }
+
+    if (batch->n_values + batch->n_columns <= batch->max_values)
+        return;
+
+    size = batch->strings->len + batch->n_values * sizeof (BatchValue);
+    if (size < YUM_DB_SORT_RUN_BYTES) {
+        batch->max_values *= 2;
+        batch->values = g_renew (BatchValue, batch->values, batch->max_values);
+        return;
+    }
+
+    batch_run_sorted (batch, &err);
+    if (err) {
+        g_critical ("%s", err->message);
+        g_error_free (err);
+    }
+}
+
+/* Before yum_db_batch_start (), whose worker then sorts the rows instead */
+void
+yum_db_batch_set_sorted (YumDbBatch *batch, gboolean sorted)
+{
+    g_return_if_fail (batch->n_values == 0);
+    g_return_if_fail (!batch->threaded);
+
+    batch->sorted = sorted && batch->sort_column >= 0;
+}
+
+static char **
+read_index_sql (sqlite3 *db, const char *table, GError **err)
+{
+    sqlite3_stmt *handle = NULL;
+    GPtrArray *sql;
+    const char *query;
+    int rc;
+
+    query = "SELECT sql FROM sqlite_master"
+        "  WHERE type = 'index' AND tbl_name = ? AND sql IS NOT NULL";
+    rc = sqlite3_prepare (db, query, -1, &handle, NULL);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not read %s indexes: %s",
+                     table, sqlite3_errmsg (db));
+        sqlite3_finalize (handle);
+        return NULL;
+    }
+
+    sql = g_ptr_array_new ();
+    sqlite3_bind_text (handle, 1, table, -1, SQLITE_STATIC);
+    while (sqlite3_step (handle) == SQLITE_ROW)
+        g_ptr_array_add (sql,
+                         g_strdup ((char *) sqlite3_column_text (handle, 0)));
+    g_ptr_array_add (sql, NULL);
+
+    sqlite3_finalize (handle);
+
+    return (char **) g_ptr_array_free (sql, FALSE);
+}
+
+/*  Move the batch to a thread of its own. From here on the batch's
+ * database belongs to the worker until yum_db_batch_join () returns. The
+ * worker builds the indexes db has on the batch's table once the last row
+ * is in. */
+void
+yum_db_batch_start (YumDbBatch *batch, sqlite3 *db, GError **err)
+{
+    BatchChunk *chunk;
+    int i;
+
+    g_return_if_fail (batch->n_values == 0);
+
+    batch->index_sql = read_index_sql (db, batch->table, err);
+    if (*err)
+        return;
+
+    batch->max_values = batch->rows_per_stmt * batch->n_columns *
+        YUM_DB_CHUNK_STMTS;
+    batch->values = g_renew (BatchValue, batch->values, batch->max_values);
+
+    batch->full_chunks = g_async_queue_new ();
+    batch->free_chunks = g_async_queue_new ();
+    for (i = 0; i < YUM_DB_WORKER_CHUNKS - 1; i++) {
+        chunk = &batch->chunks[i];
+        chunk->values = g_new (BatchValue, batch->max_values);
+        chunk->max_values = batch->max_values;
+        chunk->strings = g_string_sized_new (YUM_DB_BATCH_STRINGS);
+        g_async_queue_push (batch->free_chunks, chunk);
+    }
+
+    if (batch->sorted) {
+        batch->run.max_values = batch->max_values;
+        batch->run.values = g_new (BatchValue, batch->run.max_values);
+        batch->run.strings = g_string_sized_new (YUM_DB_BATCH_STRINGS);
+    }
+
+    batch->threaded = TRUE;
+    batch->thread = g_thread_try_new ("ymp-batch", batch_worker, batch, err);
+    if (!batch->thread)
+        batch->threaded = FALSE;
+}
+
+/*  Wait for a started batch to write its last row and build its indexes.
+ * yum_db_batch_flush () must have been called first. */
+void
+yum_db_batch_join (YumDbBatch *batch, GError **err)
+{
+    if (!batch->thread)
+        return;
+
+    g_thread_join (batch->thread);
+    batch->thread = NULL;
+
+    if (batch->error)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR, "%s", batch->error);
+    else if (batch->seconds > 0)
+        g_debug ("Wrote %" G_GINT64_FORMAT " rows to %s, %.0f rows/s",
+                 batch->rows, batch->table, batch->rows / batch->seconds);
+}
+
+void
+yum_db_batch_flush (YumDbBatch *batch, GError **err)
+{
+    if (batch->threaded) {
+        if (batch->n_values > 0)
+            batch_hand_off (batch);
+        g_async_queue_push (batch->full_chunks, &batch_end);
+        return;
+    }
+
+    if (batch->sorted)
+        batch_run_sorted (batch, err);
+    else {
+        batch_write_rows (batch, batch->values, batch->strings->str, NULL,
+                          batch->n_values / batch->n_columns, err);
+        batch_clear (batch);
+    }
+
+    if (*err)
+        return;
+
+    if (batch->seconds > 0)
+        g_debug ("Wrote %" G_GINT64_FORMAT " rows to %s, %.0f rows/s",
+                 batch->rows, batch->table, batch->rows / batch->seconds);
+}
+
+void
+yum_db_batch_free (YumDbBatch *batch)
+{
+    int i;
+
+    if (batch->thread) {
+        g_async_queue_push (batch->full_chunks, &batch_end);
+        g_thread_join (batch->thread);
+    }
+
+    if (batch->full_chunks) {
+        g_async_queue_unref (batch->full_chunks);
+        g_async_queue_unref (batch->free_chunks);
+        for (i = 0; i < YUM_DB_WORKER_CHUNKS - 1; i++) {
+            g_free (batch->chunks[i].values);
+            g_string_free (batch->chunks[i].strings, TRUE);
+        }
+    }
+    if (batch->run.strings) {
+        g_free (batch->run.values);
+        g_string_free (batch->run.strings, TRUE);
+    }
+
+    if (batch->handle)
+        sqlite3_finalize (batch->handle);
+    if (batch->strings)
+        g_string_free (batch->strings, TRUE);
+    if (batch->timer)
+        g_timer_destroy (batch->timer);
+    if (batch->files)
+        files_encoder_free (batch->files);
+
+    g_strfreev (batch->index_sql);
+    g_free (batch->error);
+    g_free (batch->values);
+    g_free (batch->table);
+    g_free (batch->columns);
+    g_free (batch);
+}
+
+/*  Create a scratch database at path holding an empty copy of db's table,
+ * for a batch to fill from another thread. */
+sqlite3 *
+yum_db_scratch_open (sqlite3 *db,
+                     const char *path,
+                     const char *table,
+                     GError **err)
+{
+    sqlite3 *scratch = NULL;
+    sqlite3_stmt *handle = NULL;
+    char *sql = NULL;
+    int rc;
+
+    rc = sqlite3_prepare (db, "SELECT sql FROM sqlite_master"
+                          "  WHERE type = 'table' AND name = ?",
+                          -1, &handle, NULL);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_text (handle, 1, table, -1, SQLITE_STATIC);
+        if (sqlite3_step (handle) == SQLITE_ROW)
+            sql = g_strdup ((char *) sqlite3_column_text (handle, 0));
+    }
+    sqlite3_finalize (handle);
+
+    if (!sql) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not read %s table definition: %s",
+                     table, sqlite3_errmsg (db));
+        return NULL;
+    }
+
+    unlink (path);
+    rc = sqlite3_open (path, &scratch);
+    if (rc == SQLITE_OK) {
+        sqlite3_exec (scratch, "PRAGMA journal_mode = OFF", NULL, NULL, NULL);
+        sqlite3_exec (scratch, "PRAGMA synchronous = 0", NULL, NULL, NULL);
+        sqlite3_exec (scratch, "PRAGMA locking_mode = EXCLUSIVE",
+                      NULL, NULL, NULL);
+        sqlite3_exec (scratch, "PRAGMA temp_store = MEMORY", NULL, NULL, NULL);
+        rc = sqlite3_exec (scratch, sql, NULL, NULL, NULL);
+    }
+
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create scratch %s table %s: %s",
+                     table, path, sqlite3_errmsg (scratch));
+        sqlite3_close (scratch);
+        unlink (path);
+        scratch = NULL;
+    }
+
+    g_free (sql);
+
+    return scratch;
+}
+
+/*  Copy table from the scratch database at path into db. db's table must
+ * be empty and have no triggers, sqlite then copies the table and index
+ * pages as they are instead of inserting row by row. */
+void
+yum_db_merge_table (sqlite3 *db,
+                    const char *path,
+                    const char *table,
+                    GError **err)
+{
+    char *sql;
+    int rc;
+
+    sql = sqlite3_mprintf ("ATTACH %Q AS scratch", path);
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    sqlite3_free (sql);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not attach %s: %s", path, sqlite3_errmsg (db));
+        return;
+    }
+
+    sql = g_strdup_printf ("INSERT INTO main.%s SELECT * FROM scratch.%s",
+                           table, table);
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    g_free (sql);
+    if (rc != SQLITE_OK)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not merge %s table: %s",
+                     table, sqlite3_errmsg (db));
+
+    sqlite3_exec (db, "DETACH scratch", NULL, NULL, NULL);
+}
+
+/* Dependency flags as stored in the compact layout, by number */
+static const char *dep_flags[] = { NULL, "EQ", "LT", "GT", "LE", "GE" };
+
+/*  Shared by the dependency views, turns the numbers back into the flags
+ * text. Anything the table has no number for is stored as text. */
+static char *
+dep_flags_sql (void)
+{
+    GString *sql;
+    guint i;
+
+    sql = g_string_new ("CASE flags");
+    for (i = 1; i < G_N_ELEMENTS (dep_flags); i++)
+        g_string_append_printf (sql, " WHEN %d THEN '%s'", i, dep_flags[i]);
+    g_string_append (sql, " ELSE flags END");
+
+    return g_string_free (sql, FALSE);
+}
+
+static int
+dep_flags_id (const char *flags)
+{
+    guint i;
+
+    for (i = 1; i < G_N_ELEMENTS (dep_flags); i++) {
+        if (!strcmp (flags, dep_flags[i]))
+            return i;
+    }
+
+    return 0;
+}
+
+/*  With normalize_deps every dependency table keeps an integer name_id in
+ * <table>_data instead of the name itself, with compact_types flags and pre
+ * are integers. Either way a view with the table's old name and columns
+ * puts the text back for readers. */
+static void
+yum_db_create_dependency_tables (sqlite3 *db,
+                                 const YumDbOptions *options,
+                                 GError **err)
+{
+    int rc;
+    const char *sql;
+    gboolean data_tables;
+    char *flags_sql;
+
+    data_tables = options->normalize_deps || options->compact_types;
+
+    if (options->normalize_deps) {
+        sql =
+            "CREATE TABLE depnames ("
+            "  id INTEGER PRIMARY KEY,"
+            "  name TEXT)";
+        rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+        if (rc != SQLITE_OK) {
+            g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                         "Can not create depnames table: %s",
+                         sqlite3_errmsg (db));
+            return;
+        }
+    }
+
+    sql =
+        "CREATE TABLE %s%s ("
+        "  %s,"
+        "  flags %s,"
+        "  epoch TEXT,"
+        "  version TEXT,"
+        "  release TEXT,"
+        "  pkgKey INTEGER %s)";
+
+    flags_sql = dep_flags_sql ();
+
+    const char *deps[] = { "requires", "provides", "conflicts", "obsoletes", NULL };
+    int i;
+
+    for (i = 0; deps[i]; i++) {
+        const char *prereq;
+        char *query;
+        GString *view;
+
+        if (!strcmp(deps[i], "requires")) {
+            prereq = options->compact_types ?
+                ", pre INTEGER DEFAULT 0" : ", pre BOOLEAN DEFAULT FALSE";
+        } else
+            prereq = "";
+
+        query = g_strdup_printf (sql, deps[i], data_tables ? "_data" : "",
+                                 options->normalize_deps ?
+                                 "name_id INTEGER" : "name TEXT",
+                                 options->compact_types ? "INTEGER" : "TEXT",
+                                 prereq);
+        rc = sqlite3_exec (db, query, NULL, NULL, NULL);
+        g_free (query);
+
+        if (rc != SQLITE_OK) {
+            g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                         "Can not create %s table: %s",
+                         deps[i], sqlite3_errmsg (db));
+            break;
+        }
+
+        if (!data_tables)
+            continue;
+
+        view = g_string_new (NULL);
+        g_string_append_printf (view, "CREATE VIEW %s AS SELECT %s AS name,"
+                                "  %s AS flags, epoch, version, release, pkgKey",
+                                deps[i],
+                                options->normalize_deps ? "depnames.name" : "name",
+                                options->compact_types ? flags_sql : "flags");
+        if (*prereq)
+            g_string_append (view, options->compact_types ?
+                             ", CASE pre WHEN 1 THEN 'TRUE'"
+                             " WHEN 0 THEN 'FALSE' END AS pre" : ", pre");
+        g_string_append_printf (view, "  FROM %s_data", deps[i]);
+        if (options->normalize_deps)
+            g_string_append_printf (view, " LEFT JOIN depnames"
+                                    " ON depnames.id = %s_data.name_id",
+                                    deps[i]);
+
+        rc = sqlite3_exec (db, view->str, NULL, NULL, NULL);
+        g_string_free (view, TRUE);
+
+        if (rc != SQLITE_OK) {
+            g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                         "Can not create %s view: %s",
+                         deps[i], sqlite3_errmsg (db));
+            break;
+        }
+    }
+
+    g_free (flags_sql);
+}
+
+/* Digests up to sha512 */
+#define YUM_DB_MAX_DIGEST 64
+
+/*  The compact layout stores pkgIds as raw bytes. Only lowercase hex comes
+ * back from the views unchanged, anything else is stored as text. Returns
+ * the number of bytes written to digest or -1. */
+static int
+pkgid_to_digest (const char *pkgId, guchar *digest)
+{
+    int len;
+    int i;
+
+    len = strlen (pkgId);
+    if (len == 0 || len % 2 || len > YUM_DB_MAX_DIGEST * 2)
+        return -1;
+
+    for (i = 0; i < len; i++) {
+        if (!g_ascii_isdigit (pkgId[i]) && (pkgId[i] < 'a' || pkgId[i] > 'f'))
+            return -1;
+    }
+
+    for (i = 0; i < len / 2; i++)
+        digest[i] = g_ascii_xdigit_value (pkgId[2 * i]) << 4 |
+            g_ascii_xdigit_value (pkgId[2 * i + 1]);
+
+    return len / 2;
+}
+
+/*  pkgId as text. The compact layout indexes this rather than the raw
+ * bytes, so WHERE pkgId = ? on the packages view is an index seek too. */
+#define PKGID_TEXT_SQL \
+    "CASE typeof(pkgId) WHEN 'blob' THEN lower(hex(pkgId))" \
+    " ELSE pkgId END"
+#define PKGID_VIEW_SQL PKGID_TEXT_SQL " AS pkgId"
+
+/*  The packages table of filelists and other databases, in the compact
+ * layout a packages view over packages_data. */
+static void
+yum_db_create_package_ids_table (sqlite3 *db,
+                                 const YumDbOptions *options,
+                                 GError **err)
+{
+    int rc;
+    const char *sql;
+
+    if (!options->compact_types) {
+        sql =
+            "CREATE TABLE packages ("
+            "  pkgKey INTEGER PRIMARY KEY,"
+            "  pkgId TEXT)";
+        rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+        if (rc != SQLITE_OK)
+            g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                         "Can not create packages table: %s",
+                         sqlite3_errmsg (db));
+        return;
+    }
+
+    sql =
+        "CREATE TABLE packages_data ("
+        "  pkgKey INTEGER PRIMARY KEY,"
+        "  pkgId BLOB)";
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create packages_data table: %s",
+                     sqlite3_errmsg (db));
+        return;
+    }
+
+    sql = "CREATE VIEW packages AS SELECT pkgKey, " PKGID_VIEW_SQL
+        "  FROM packages_data";
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create packages view: %s",
+                     sqlite3_errmsg (db));
+}
+
+/*  The normalize_dirs layout keeps every directory once in dirs, which the
+ * filelists tables refer to by id. Primary files keep their full paths:
+ * splitting them would not save space next to the filenames index on the
+ * full path that lookups by name need. */
+static void
+yum_db_create_dirs_table (sqlite3 *db, GError **err)
+{
+    const char *sql;
+    int rc;
+
+    sql =
+        "CREATE TABLE dirs ("
+        "  id INTEGER PRIMARY KEY,"
+        "  path TEXT)";
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create dirs table: %s",
+                     sqlite3_errmsg (db));
+}
+
+static ColumnEncoding
+package_column_encoding (guint i, const YumDbOptions *options)
+{
+    switch (package_columns[i].encoding) {
+    case COLUMN_DIGEST:
+    case COLUMN_TYPE:
+        if (options->compact_types)
+            return package_columns[i].encoding;
+        break;
+    case COLUMN_STRING:
+        if (options->dictionary_columns)
+            return COLUMN_STRING;
+        break;
+    case COLUMN_PLAIN:
+        break;
+    }
+
+    return COLUMN_PLAIN;
+}
+
+/*  The search_index layout: an FTS5 index over the summary and description
+ * of packages, with the trigram tokenizer so any substring of three or
+ * more characters can be matched. It only holds the index, the text stays
+ * in packages. Needs an SQLite with FTS5 and 3.34 or later for trigram,
+ * the cache is built without it otherwise. */
+static void
+yum_db_create_search_table (sqlite3 *db)
+{
+    const char *sql;
+    int rc;
+
+    sql =
+        "CREATE VIRTUAL TABLE packages_fts USING fts5 ("
+        "  summary, description,"
+        "  content = 'packages', content_rowid = 'pkgKey',"
+        "  tokenize = 'trigram')";
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        g_warning ("Can not create search index, building without: %s",
+                   sqlite3_errmsg (db));
+}
+
+/*  The summary_tables layout: what yum works out over all of packages
+ * again at every start, kept ready by yum_db_build_summary_tables ().
+ * newest has the newest package of every name and arch, srpm_packages
+ * the packages of every source rpm and arches the space separated
+ * arches of every name. */
+static void
+yum_db_create_summary_tables (sqlite3 *db, GError **err)
+{
+    const char *sql;
+    int rc;
+
+    sql =
+        "CREATE TABLE newest ("
+        "  name TEXT,"
+        "  arch TEXT,"
+        "  pkgKey INTEGER,"
+        "  PRIMARY KEY (name, arch)) WITHOUT ROWID;"
+        "CREATE TABLE srpm_packages ("
+        "  rpm_sourcerpm TEXT,"
+        "  pkgKey INTEGER,"
+        "  PRIMARY KEY (rpm_sourcerpm, pkgKey)) WITHOUT ROWID;"
+        "CREATE TABLE arches ("
+        "  name TEXT PRIMARY KEY,"
+        "  arches TEXT) WITHOUT ROWID";
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create summary tables: %s",
+                     sqlite3_errmsg (db));
+}
+
+void
+yum_db_create_primary_tables (sqlite3 *db,
+                              const YumDbOptions *options,
+                              GError **err)
+{
+    int rc;
+    const char *sql;
+    const char *name;
+    GString *table;
+    GString *view;
+    char *query;
+    guint i;
+
+    table = g_string_new (NULL);
+    view = g_string_new ("CREATE VIEW packages AS SELECT pkgKey");
+
+    for (i = 0; i < N_PACKAGE_COLUMNS; i++) {
+        name = package_columns[i].name;
+
+        switch (package_column_encoding (i, options)) {
+        case COLUMN_PLAIN:
+            g_string_append_printf (table, ",  %s %s",
+                                    name, package_columns[i].type);
+            g_string_append_printf (view, ", %s", name);
+            break;
+        case COLUMN_DIGEST:
+            g_string_append_printf (table, ",  %s BLOB", name);
+            g_string_append (view, ", " PKGID_VIEW_SQL);
+            break;
+        case COLUMN_TYPE:
+        case COLUMN_STRING:
+            query = g_strdup_printf ("CREATE TABLE %ss ("
+                                     "  id INTEGER PRIMARY KEY,"
+                                     "  name TEXT)", name);
+            rc = sqlite3_exec (db, query, NULL, NULL, NULL);
+            g_free (query);
+            if (rc != SQLITE_OK) {
+                g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                             "Can not create %ss table: %s",
+                             name, sqlite3_errmsg (db));
+                goto cleanup;
+            }
+
+            g_string_append_printf (table, ",  %s_id INTEGER", name);
+            g_string_append_printf (view, ", (SELECT name FROM %ss"
+                                    " WHERE id = %s_id) AS %s",
+                                    name, name, name);
+            break;
+        }
+    }
+
+    /* Filled in by yum_db_fill_evr_columns () */
+    if (options->evr_columns) {
+        g_string_append (table, ",  nevra TEXT,  evr BLOB");
+        g_string_append (view, ", nevra, evr");
+    }
+
+    /* Any encoded column puts the real table behind a view */
+    if (options->compact_types || options->dictionary_columns) {
+        g_string_prepend (table, "CREATE TABLE packages_data ("
+                          "  pkgKey INTEGER PRIMARY KEY");
+        g_string_append (view, " FROM packages_data");
+    } else
+        g_string_prepend (table, "CREATE TABLE packages ("
+                          "  pkgKey INTEGER PRIMARY KEY");
+    g_string_append_c (table, ')');
+
+    rc = sqlite3_exec (db, table->str, NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create packages table: %s",
+                     sqlite3_errmsg (db));
+        goto cleanup;
+    }
+
+    if (options->compact_types || options->dictionary_columns) {
+        rc = sqlite3_exec (db, view->str, NULL, NULL, NULL);
+        if (rc != SQLITE_OK) {
+            g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                         "Can not create packages view: %s",
+                         sqlite3_errmsg (db));
+            goto cleanup;
+        }
+    }
+
+    sql =
+        "CREATE TABLE files ("
+        "  name TEXT,"
+        "  type TEXT,"
+        "  pkgKey INTEGER)";
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create files table: %s",
+                     sqlite3_errmsg (db));
+        goto cleanup;
+    }
+
+    yum_db_create_dependency_tables (db, options, err);
+    if (*err)
+        goto cleanup;
+
+    if (options->search_index)
+        yum_db_create_search_table (db);
+
+    if (options->summary_tables)
+        yum_db_create_summary_tables (db, err);
+
+ cleanup:
+    g_string_free (table, TRUE);
+    g_string_free (view, TRUE);
+}
+
+/*  Fills packages_fts from packages once they are all in, and has it
+ * follow packages that go away later. */
+static void
+yum_db_build_search_index (sqlite3 *db, GError **err)
+{
+    char *table;
+    char *sql;
+    int rc;
+
+    rc = sqlite3_exec (db, "INSERT INTO packages_fts (packages_fts)"
+                       "  VALUES ('rebuild')", NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not build search index: %s",
+                     sqlite3_errmsg (db));
+        return;
+    }
+
+    table = table_for (db, "packages");
+    sql = g_strdup_printf ("CREATE TRIGGER IF NOT EXISTS remove_search"
+                           "  AFTER DELETE ON %s"
+                           "  BEGIN"
+                           "    INSERT INTO packages_fts"
+                           "      (packages_fts, rowid, summary, description)"
+                           "      VALUES ('delete', old.pkgKey, old.summary,"
+                           "              old.description);"
+                           "  END;", table);
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    g_free (sql);
+    g_free (table);
+
+    if (rc != SQLITE_OK)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create remove_search trigger: %s",
+                     sqlite3_errmsg (db));
+}
+
+/*  Fills in the nevra and evr columns of the evr_columns layout for the
+ * packages added since the last time and indexes them, so the newest
+ * package of a name and a package by NEVRA are both one index seek.
+ * nevra always has the epoch, as in foo-0:1.0-1.noarch. */
+static void
+yum_db_fill_evr_columns (sqlite3 *db, const char *table, GError **err)
+{
+    char *sql;
+    int rc;
+
+    sql = g_strdup_printf ("UPDATE %s SET"
+                           "  nevra = name || '-' ||"
+                           "    coalesce (nullif (epoch, ''), '0') || ':' ||"
+                           "    version || '-' || release || '.' || arch,"
+                           "  evr = ymp_evr_key (epoch, version, release)"
+                           "  WHERE evr IS NULL", table);
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    g_free (sql);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not fill in nevra and evr: %s",
+                     sqlite3_errmsg (db));
+        return;
+    }
+
+    sql = g_strdup_printf ("CREATE INDEX IF NOT EXISTS packagenevra"
+                           "  ON %s (nevra);"
+                           "CREATE INDEX IF NOT EXISTS packageevr"
+                           "  ON %s (name, evr)", table, table);
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    g_free (sql);
+    if (rc != SQLITE_OK)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create nevra and evr indexes: %s",
+                     sqlite3_errmsg (db));
+}
+
+/*  Fills the tables of the summary_tables layout from table, the real
+ * packages table, from scratch, and has them follow the packages that go
+ * away later. */
+static void
+yum_db_build_summary_tables (sqlite3 *db, const char *table, GError **err)
+{
+    GTimer *timer;
+    const char *evr_key;
+    char *type;
+    char *sql;
+    int rc;
+
+    timer = g_timer_new ();
+
+    type = yum_db_column_type (db, table, "evr");
+    evr_key = type ? "evr" : "ymp_evr_key (epoch, version, release)";
+    g_free (type);
+
+    /* The bare pkgKey of a max () aggregate comes from the max row */
+    sql = g_strdup_printf
+        ("DELETE FROM newest;"
+         "DELETE FROM srpm_packages;"
+         "DELETE FROM arches;"
+         "INSERT INTO newest SELECT name, arch, pkgKey FROM"
+         "  (SELECT name, arch, pkgKey, max (%s) FROM %s"
+         "   GROUP BY name, arch);"
+         "INSERT OR IGNORE INTO srpm_packages"
+         "  SELECT rpm_sourcerpm, pkgKey FROM %s"
+         "  WHERE rpm_sourcerpm IS NOT NULL;"
+         "INSERT INTO arches SELECT name, group_concat (arch, ' ') FROM"
+         "  (SELECT DISTINCT name, arch FROM %s ORDER BY name, arch)"
+         "  GROUP BY name;"
+         "CREATE TRIGGER IF NOT EXISTS remove_summaries"
+         "  AFTER DELETE ON %s"
+         "  BEGIN"
+         "    DELETE FROM srpm_packages WHERE"
+         "      rpm_sourcerpm = old.rpm_sourcerpm AND pkgKey = old.pkgKey;"
+         "    DELETE FROM newest WHERE"
+         "      name = old.name AND arch = old.arch AND pkgKey = old.pkgKey;"
+         "    INSERT OR IGNORE INTO newest SELECT name, arch, pkgKey FROM"
+         "      (SELECT name, arch, pkgKey, max (%s) FROM %s"
+         "       WHERE name = old.name AND arch = old.arch"
+         "       GROUP BY name, arch);"
+         "    DELETE FROM arches WHERE name = old.name;"
+         "    INSERT INTO arches SELECT name, group_concat (arch, ' ') FROM"
+         "      (SELECT DISTINCT name, arch FROM %s"
+         "       WHERE name = old.name ORDER BY arch)"
+         "      GROUP BY name;"
+         "  END",
+         evr_key, table, table, table, table, evr_key, table, table);
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    g_free (sql);
+
+    if (rc != SQLITE_OK)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not build summary tables: %s",
+                     sqlite3_errmsg (db));
+    else
+        g_debug ("Built summary tables in %.2f seconds",
+                 g_timer_elapsed (timer, NULL));
+    g_timer_destroy (timer);
+}
+
+void
+yum_db_create_primary_triggers (sqlite3 *db, GError **err)
+{
+    char *table;
+    char *type;
+
+    yum_db_create_removal_trigger (db, "removals",
+                                   yum_db_primary_package_tables, err);
+    if (*err)
+        return;
+
+    /* Like the triggers, only worth doing once the packages are in */
+    if (yum_db_table_exists (db, "packages_fts"))
+        yum_db_build_search_index (db, err);
+    if (*err)
+        return;
+
+    table = table_for (db, "packages");
+    type = yum_db_column_type (db, table, "evr");
+    if (type)
+        yum_db_fill_evr_columns (db, table, err);
+    g_free (type);
+
+    if (!*err && yum_db_table_exists (db, "newest"))
+        yum_db_build_summary_tables (db, table, err);
+    g_free (table);
+}
+
+/*  Calls fn with the pkgKey and score of the packages whose summary or
+ * description contains term, best first, at most limit of them unless
+ * limit is 0. Terms too short for the trigram index, and caches built
+ * without the index, fall back to scanning packages. */
+void
+yum_db_search_packages (sqlite3 *db,
+                        const char *term,
+                        int limit,
+                        YumDbSearchFn fn,
+                        gpointer user_data,
+                        GError **err)
+{
+    sqlite3_stmt *handle = NULL;
+    GString *match;
+    const char *p;
+    int rc;
+
+    match = g_string_new (NULL);
+    if (g_utf8_strlen (term, -1) >= 3 &&
+        yum_db_table_exists (db, "packages_fts")) {
+        /* As one quoted phrase, so the term is matched as a substring */
+        g_string_append_c (match, '"');
+        for (p = term; *p; p++) {
+            if (*p == '"')
+                g_string_append_c (match, '"');
+            g_string_append_c (match, *p);
+        }
+        g_string_append_c (match, '"');
+
+        /* bm25 () scores are negative, a hit in the summary weighs more */
+        rc = sqlite3_prepare (db,
+                              "SELECT rowid, -bm25 (packages_fts, 10.0, 1.0)"
+                              "  FROM packages_fts WHERE packages_fts MATCH ?"
+                              "  ORDER BY bm25 (packages_fts, 10.0, 1.0)"
+                              "  LIMIT ?",
+                              -1, &handle, NULL);
+    } else {
+        /* The term's own wildcards match only themselves */
+        g_string_append_c (match, '%');
+        for (p = term; *p; p++) {
+            if (*p == '%' || *p == '_' || *p == '\\')
+                g_string_append_c (match, '\\');
+            g_string_append_c (match, *p);
+        }
+        g_string_append_c (match, '%');
+
+        rc = sqlite3_prepare (db,
+                              "SELECT pkgKey, 0.0 FROM packages"
+                              "  WHERE summary LIKE ?1 ESCAPE '\\'"
+                              "    OR description LIKE ?1 ESCAPE '\\'"
+                              "  LIMIT ?2",
+                              -1, &handle, NULL);
+    }
+
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not prepare package search: %s",
+                     sqlite3_errmsg (db));
+        goto cleanup;
+    }
+
+    sqlite3_bind_text (handle, 1, match->str, match->len, SQLITE_STATIC);
+    sqlite3_bind_int (handle, 2, limit > 0 ? limit : -1);
+
+    while ((rc = sqlite3_step (handle)) == SQLITE_ROW)
+        fn (sqlite3_column_int64 (handle, 0),
+            sqlite3_column_double (handle, 1), user_data);
+
+    if (rc != SQLITE_DONE)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not search packages: %s",
+                     sqlite3_errmsg (db));
+
+ cleanup:
+    sqlite3_finalize (handle);
+    g_string_free (match, TRUE);
+}
+
+/* Run CREATE INDEX sql on the table behind table */
+static void
+yum_db_create_index (sqlite3 *db,
+                     const char *index,
+                     const char *table,
+                     const char *columns,
+                     GError **err)
+{
+    char *real_table;
+    char *sql;
+    int rc;
+
+    real_table = table_for (db, table);
+    sql = g_strdup_printf ("CREATE INDEX IF NOT EXISTS %s ON %s (%s)",
+                           index, real_table, columns);
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    g_free (sql);
+    g_free (real_table);
+
+    if (rc != SQLITE_OK)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create %s index: %s",
+                     index, sqlite3_errmsg (db));
+}
+
+/* The pkgId index, on what the packages view shows in every layout */
+static void
+yum_db_create_pkgid_index (sqlite3 *db, const char *index, GError **err)
+{
+    yum_db_create_index (db, index, "packages",
+                         yum_db_is_compact (db) ? PKGID_TEXT_SQL : "pkgId",
+                         err);
+}
+
+/*  The dirs table of the normalize_dirs layout, looked up by path by the
+ * views' readers. */
+static void
+yum_db_index_dirs (sqlite3 *db, GError **err)
+{
+    const char *sql;
+    int rc;
+
+    if (!yum_db_table_exists (db, "dirs"))
+        return;
+
+    sql = "CREATE UNIQUE INDEX IF NOT EXISTS dirspath ON dirs (path)";
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create dirspath index: %s",
+                     sqlite3_errmsg (db));
+}
+
+void
+yum_db_index_primary_tables (sqlite3 *db, GError **err)
+{
+    int rc;
+    const char *sql;
+    char *query;
+
+    yum_db_create_index (db, "packagename", "packages", "name", err);
+    if (*err)
+        return;
+
+    yum_db_create_pkgid_index (db, "packageId", err);
+    if (*err)
+        return;
+
+    yum_db_create_index (db, "filenames", "files", "name", err);
+    if (*err)
+        return;
+
+    yum_db_create_index (db, "pkgfiles", "files", "pkgKey", err);
+    if (*err)
+        return;
+
+    const char *deps[] = { "requires", "provides", "conflicts", "obsoletes", NULL };
+    int i;
+
+    const char *name_column = "name";
+
+    if (yum_db_has_depnames (db)) {
+        sql = "CREATE UNIQUE INDEX IF NOT EXISTS depnamesname"
+            "  ON depnames (name)";
+        rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+        if (rc != SQLITE_OK) {
+            g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                         "Can not create depnamesname index: %s",
+                         sqlite3_errmsg (db));
+            return;
+        }
+
+        name_column = "name_id";
+    }
+
+    for (i = 0; deps[i]; i++) {
+        query = g_strdup_printf ("pkg%s", deps[i]);
+        yum_db_create_index (db, query, deps[i], "pkgKey", err);
+        g_free (query);
+        if (*err)
+            return;
+
+        if (i < 2) {
+            query = g_strdup_printf ("%sname", deps[i]);
+            yum_db_create_index (db, query, deps[i], name_column, err);
+            g_free (query);
+            if (*err)
+                return;
+        }
+    }
+}
+
+/*  Names such as dependency names are handed out ids in memory as packages
+ * come in, and new ones are written to their (id, name) table alongside
+ * the rows using them. */
+typedef struct {
+    GHashTable *ids;
+    GStringChunk *chunk;
+    gint64 last_id;
+    YumDbBatch *batch;
+    GString *key;   /* See yum_db_names_intern_len () */
+    gint64 saved;   /* Rough bytes saved over storing the names inline */
+} YumDbNames;
+
+static void
+yum_db_names_free (YumDbNames *names)
+{
+    if (names->batch)
+        yum_db_batch_free (names->batch);
+
+    g_string_free (names->key, TRUE);
+    g_hash_table_destroy (names->ids);
+    g_string_chunk_free (names->chunk);
+    g_free (names);
+}
+
+/*  A dictionary preloaded with the names table already has, table's
+ * columns being id and column. */
+static YumDbNames *
+yum_db_names_open (sqlite3 *db,
+                   const char *table,
+                   const char *column,
+                   GError **err)
+{
+    YumDbNames *names;
+    sqlite3_stmt *handle = NULL;
+    const char *name;
+    char *query;
+    gint64 id;
+    int rc;
+
+    names = g_new0 (YumDbNames, 1);
+    names->ids = g_hash_table_new (g_str_hash, g_str_equal);
+    names->chunk = g_string_chunk_new (YUM_DB_BATCH_STRINGS);
+    names->key = g_string_new (NULL);
+
+    query = g_strdup_printf ("SELECT id, %s FROM %s", column, table);
+    rc = sqlite3_prepare (db, query, -1, &handle, NULL);
+    g_free (query);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not prepare SQL clause: %s",
+                     sqlite3_errmsg (db));
+        goto cleanup;
+    }
+
+    while ((rc = sqlite3_step (handle)) == SQLITE_ROW) {
+        id = sqlite3_column_int64 (handle, 0);
+        name = (const char *) sqlite3_column_text (handle, 1);
+
+        g_hash_table_insert (names->ids,
+                             g_string_chunk_insert (names->chunk, name),
+                             GINT_TO_POINTER ((gint) id));
+        names->last_id = MAX (names->last_id, id);
+    }
+
+    if (rc != SQLITE_DONE) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Error reading from SQL: %s",
+                     sqlite3_errmsg (db));
+        goto cleanup;
+    }
+
+    query = g_strconcat ("id, ", column, NULL);
+    names->batch = yum_db_batch_new (db, table, query, 2, -1, err);
+    g_free (query);
+
+ cleanup:
+    sqlite3_finalize (handle);
+
+    if (*err) {
+        yum_db_names_free (names);
+        names = NULL;
+    }
+
+    return names;
+}
+
+/* Bytes sqlite takes to store id as an integer */
+static int
+id_size (gint64 id)
+{
+    if (id < 128)
+        return 1;
+    if (id < 32768)
+        return 2;
+    if (id < 8388608)
+        return 3;
+
+    return 4;
+}
+
+static gint64
+yum_db_names_intern (YumDbNames *names, const char *name)
+{
+    gpointer id;
+    char *key;
+    int len;
+
+    len = strlen (name);
+
+    id = g_hash_table_lookup (names->ids, name);
+    if (id) {
+        names->saved += len - id_size (GPOINTER_TO_INT (id));
+        return GPOINTER_TO_INT (id);
+    }
+
+    key = g_string_chunk_insert (names->chunk, name);
+    names->last_id++;
+    g_hash_table_insert (names->ids, key,
+                         GINT_TO_POINTER ((gint) names->last_id));
+
+    /* The first use pays for the id in the names table as well */
+    names->saved -= 2 * id_size (names->last_id);
+
+    batch_int (names->batch, names->last_id);
+    batch_text (names->batch, key);
+    batch_row_done (names->batch);
+
+    return names->last_id;
+}
+
+/* Same for the first len bytes of name */
+static gint64
+yum_db_names_intern_len (YumDbNames *names, const char *name, int len)
+{
+    g_string_truncate (names->key, 0);
+    g_string_append_len (names->key, name, len);
+
+    return yum_db_names_intern (names, names->key->str);
+}
+
+struct _YumDbLayout {
+    gboolean compact;               /* YumDbOptions.compact_types */
+    YumDbNames *dep_names;          /* YumDbOptions.normalize_deps */
+    YumDbNames *dirs;               /* YumDbOptions.normalize_dirs */
+    gboolean code_files;            /* YumDbOptions.front_code_files */
+    gboolean compress_files;        /* YumDbOptions.compress_files */
+    GString *files;                 /* Scratch for the coded filenames */
+    gint64 files_saved;             /* Bytes coding filenames saved */
+    gboolean path_index;            /* YumDbOptions.path_index */
+    /* Dictionary of each packages column, NULL for columns stored inline */
+    YumDbNames *package_names[N_PACKAGE_COLUMNS];
+};
+
+/*  Works out how db was created, see YumDbOptions, and loads the
+ * dictionaries the writers below need for it. */
+YumDbLayout *
+yum_db_layout_open (sqlite3 *db, GError **err)
+{
+    YumDbLayout *layout;
+    char *table;
+    char *type;
+    guint i;
+
+    layout = g_new0 (YumDbLayout, 1);
+    layout->compact = yum_db_is_compact (db);
+    layout->path_index = yum_db_table_exists (db, "filepaths");
+
+    type = yum_db_column_type (db, "filelist_data", "filenames");
+    if (type && strcmp (type, "TEXT")) {
+        layout->code_files = TRUE;
+        layout->compress_files = !strcmp (type, FILENAMES_COMPRESSED) &&
+            yum_filenames_can_compress ();
+        layout->files = g_string_sized_new (ENCODED_PACKAGE_FILE_FILES);
+    }
+    g_free (type);
+
+    if (yum_db_has_depnames (db)) {
+        layout->dep_names = yum_db_names_open (db, "depnames", "name",
+                                               err);
+        if (*err)
+            goto cleanup;
+    }
+
+    if (yum_db_table_exists (db, "dirs")) {
+        layout->dirs = yum_db_names_open (db, "dirs", "path", err);
+        if (*err)
+            goto cleanup;
+    }
+
+    for (i = 0; i < N_PACKAGE_COLUMNS && !*err; i++) {
+        if (package_columns[i].encoding != COLUMN_TYPE &&
+            package_columns[i].encoding != COLUMN_STRING)
+            continue;
+
+        table = g_strconcat (package_columns[i].name, "s", NULL);
+        if (yum_db_table_exists (db, table))
+            layout->package_names[i] = yum_db_names_open (db, table, "name",
+                                                          err);
+        g_free (table);
+    }
+
+ cleanup:
+    if (*err) {
+        yum_db_layout_free (layout);
+        layout = NULL;
+    }
+
+    return layout;
+}
+
+/* Write out the names handed out so far */
+void
+yum_db_layout_flush (YumDbLayout *layout, GError **err)
+{
+    gint64 saved = 0;
+    gboolean dictionaries = FALSE;
+    guint i;
+
+    if (layout->dep_names) {
+        yum_db_batch_flush (layout->dep_names->batch, err);
+        if (*err)
+            return;
+    }
+
+    if (layout->dirs) {
+        yum_db_batch_flush (layout->dirs->batch, err);
+        if (*err)
+            return;
+    }
+
+    for (i = 0; i < N_PACKAGE_COLUMNS; i++) {
+        if (!layout->package_names[i])
+            continue;
+
+        yum_db_batch_flush (layout->package_names[i]->batch, err);
+        if (*err)
+            return;
+
+        if (package_columns[i].encoding == COLUMN_STRING) {
+            saved += layout->package_names[i]->saved;
+            layout->package_names[i]->saved = 0;
+            dictionaries = TRUE;
+        }
+    }
+
+    if (dictionaries)
+        g_message ("Dictionary columns saved about %" G_GINT64_FORMAT
+                   " KiB in packages", saved / 1024);
+
+    if (layout->code_files && layout->files_saved) {
+        g_message ("Coding filenames saved about %" G_GINT64_FORMAT
+                   " KiB in filelist", layout->files_saved / 1024);
+        layout->files_saved = 0;
+    }
+}
+
+void
+yum_db_layout_free (YumDbLayout *layout)
+{
+    guint i;
+
+    if (layout->dep_names)
+        yum_db_names_free (layout->dep_names);
+    if (layout->dirs)
+        yum_db_names_free (layout->dirs);
+    if (layout->files)
+        g_string_free (layout->files, TRUE);
+
+    for (i = 0; i < N_PACKAGE_COLUMNS; i++) {
+        if (layout->package_names[i])
+            yum_db_names_free (layout->package_names[i]);
+    }
+
+    g_free (layout);
+}
+
+static gboolean
+layout_has_package_names (YumDbLayout *layout)
+{
+    guint i;
+
+    for (i = 0; i < N_PACKAGE_COLUMNS; i++) {
+        if (layout->package_names[i])
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*  The real table behind table, which is a view in some layouts. To be
+ * freed by the caller. */
+char *
+yum_db_layout_table (YumDbLayout *layout, const char *table)
+{
+    if (!strcmp (table, "packages")) {
+        if (layout->compact || layout_has_package_names (layout))
+            return g_strdup ("packages_data");
+        return g_strdup (table);
+    }
+
+    if (!strcmp (table, "requires") || !strcmp (table, "provides") ||
+        !strcmp (table, "conflicts") || !strcmp (table, "obsoletes")) {
+        if (layout->compact || layout->dep_names)
+            return g_strconcat (table, "_data", NULL);
+    }
+
+    if (!strcmp (table, "files") || !strcmp (table, "filelist")) {
+        if (layout->dirs)
+            return g_strconcat (table, "_data", NULL);
+    }
+
+    if (!strcmp (table, "filelist") && layout->code_files)
+        return g_strdup ("filelist_data");
+
+    return g_strdup (table);
+}
+
+/* The packages columns as the writers bind them, after pkgKey */
+static char *
+package_insert_columns (YumDbLayout *layout)
+{
+    GString *columns;
+    guint i;
+
+    columns = g_string_new (NULL);
+    for (i = 0; i < N_PACKAGE_COLUMNS; i++) {
+        g_string_append_printf (columns, "%s%s%s", i ? ", " : "",
+                                package_columns[i].name,
+                                layout->package_names[i] ? "_id" : "");
+    }
+
+    return g_string_free (columns, FALSE);
+}
+
+static void
+bind_pkgid (sqlite3_stmt *handle, int param, YumDbLayout *layout, Package *p)
+{
+    guchar digest[YUM_DB_MAX_DIGEST];
+    int len = -1;
+
+    if (layout->compact)
+        len = pkgid_to_digest (p->pkgId, digest);
+
+    if (len > 0)
+        sqlite3_bind_blob (handle, param, digest, len, SQLITE_TRANSIENT);
+    else
+        sqlite3_bind_text (handle, param, p->pkgId, -1, SQLITE_STATIC);
+}
+
+sqlite3_stmt *
+yum_db_package_prepare (sqlite3 *db, YumDbLayout *layout, GError **err)
+{
+    int rc;
+    sqlite3_stmt *handle = NULL;
+    GString *query;
+    char *table;
+    char *columns;
+    guint i;
+
+    table = yum_db_layout_table (layout, "packages");
+    columns = package_insert_columns (layout);
+
+    query = g_string_new (NULL);
+    g_string_append_printf (query, "INSERT INTO %s (%s) VALUES (?",
+                            table, columns);
+    for (i = 1; i < N_PACKAGE_COLUMNS; i++)
+        g_string_append (query, ", ?");
+    g_string_append_c (query, ')');
+
+    rc = sqlite3_prepare (db, query->str, -1, &handle, NULL);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not prepare packages insertion: %s",
+                     sqlite3_errmsg (db));
+        sqlite3_finalize (handle);
+        handle = NULL;
+    }
+
+    g_string_free (query, TRUE);
+    g_free (columns);
+    g_free (table);
+
+    return handle;
+}
+
+/* Bind text for the packages column param binds, by id if it has names */
+static void
+bind_package_text (sqlite3_stmt *handle,
+                   int param,
+                   YumDbLayout *layout,
+                   const char *text)
+{
+    YumDbNames *names = layout->package_names[param - 1];
+
+    if (names && text)
+        sqlite3_bind_int64 (handle, param, yum_db_names_intern (names, text));
+    else
+        sqlite3_bind_text (handle, param, text, -1, SQLITE_STATIC);
+}
+
+void
+yum_db_package_write (sqlite3 *db,
+                      sqlite3_stmt *handle,
+                      YumDbLayout *layout,
+                      Package *p)
+{
+    int rc;
+
+    bind_pkgid (handle, 1, layout, p);
+    bind_package_text (handle, 2,  layout, p->name);
+    bind_package_text (handle, 3,  layout, p->arch);
+    bind_package_text (handle, 4,  layout, p->version);
+    bind_package_text (handle, 5,  layout, p->epoch);
+    bind_package_text (handle, 6,  layout, p->release);
+    bind_package_text (handle, 7,  layout, p->summary);
+    bind_package_text (handle, 8,  layout, p->description);
+    bind_package_text (handle, 9,  layout, p->url);
+    sqlite3_bind_int  (handle, 10, p->time_file);
+    sqlite3_bind_int  (handle, 11, p->time_build);
+    bind_package_text (handle, 12, layout, p->rpm_license);
+    bind_package_text (handle, 13, layout, p->rpm_vendor);
+    bind_package_text (handle, 14, layout, p->rpm_group);
+    bind_package_text (handle, 15, layout, p->rpm_buildhost);
+    bind_package_text (handle, 16, layout, p->rpm_sourcerpm);
+    sqlite3_bind_int  (handle, 17, p->rpm_header_start);
+    sqlite3_bind_int  (handle, 18, p->rpm_header_end);
+    bind_package_text (handle, 19, layout, p->rpm_packager);
+    sqlite3_bind_int64  (handle, 20, p->size_package);
+    sqlite3_bind_int64  (handle, 21, p->size_installed);
+    sqlite3_bind_int64  (handle, 22, p->size_archive);
+    bind_package_text (handle, 23, layout, p->location_href);
+    bind_package_text (handle, 24, layout, p->location_base);
+    bind_package_text (handle, 25, layout, p->checksum_type);
+
+    rc = sqlite3_step (handle);
+    sqlite3_reset (handle);
+
+    if (rc != SQLITE_DONE) {
+        g_critical ("Error adding package to SQL: %s",
+                    sqlite3_errmsg (db));
+    } else
+        p->pkgKey = sqlite3_last_insert_rowid (db);
+}
+
+/*  Batched packages insertion for builds that hand out pkgKeys themselves
+ * and so don't need last_insert_rowid. */
+YumDbBatch *
+yum_db_package_batch_prepare (sqlite3 *db, YumDbLayout *layout, GError **err)
+{
+    YumDbBatch *batch;
+    char *columns;
+    char *names;
+    char *table;
+
+    names = package_insert_columns (layout);
+    columns = g_strconcat ("pkgKey, ", names, NULL);
+    table = yum_db_layout_table (layout, "packages");
+
+    batch = yum_db_batch_new (db, table, columns, N_PACKAGE_COLUMNS + 1, -1,
+                              err);
+    if (batch)
+        batch->layout = layout;
+
+    g_free (table);
+    g_free (columns);
+    g_free (names);
+
+    return batch;
+}
+
+/* Queue text for packages column i, by id if it has names */
+static void
+batch_package_text (YumDbBatch *batch, int i, const char *text)
+{
+    YumDbNames *names = batch->layout->package_names[i];
+
+    if (names && text)
+        batch_int (batch, yum_db_names_intern (names, text));
+    else
+        batch_text (batch, text);
+}
+
+void
+yum_db_package_batch_write (sqlite3 *db, YumDbBatch *batch, Package *p)
+{
+    guchar digest[YUM_DB_MAX_DIGEST];
+    int len = -1;
+
+    batch_int  (batch, p->pkgKey);
+    if (batch->layout->compact)
+        len = pkgid_to_digest (p->pkgId, digest);
+    if (len > 0)
+        batch_blob (batch, digest, len);
+    else
+        batch_text (batch, p->pkgId);
+    batch_package_text (batch, 1,  p->name);
+    batch_package_text (batch, 2,  p->arch);
+    batch_package_text (batch, 3,  p->version);
+    batch_package_text (batch, 4,  p->epoch);
+    batch_package_text (batch, 5,  p->release);
+    batch_package_text (batch, 6,  p->summary);
+    batch_package_text (batch, 7,  p->description);
+    batch_package_text (batch, 8,  p->url);
+    batch_int  (batch, p->time_file);
+    batch_int  (batch, p->time_build);
+    batch_package_text (batch, 11, p->rpm_license);
+    batch_package_text (batch, 12, p->rpm_vendor);
+    batch_package_text (batch, 13, p->rpm_group);
+    batch_package_text (batch, 14, p->rpm_buildhost);
+    batch_package_text (batch, 15, p->rpm_sourcerpm);
+    batch_int  (batch, p->rpm_header_start);
+    batch_int  (batch, p->rpm_header_end);
+    batch_package_text (batch, 18, p->rpm_packager);
+    batch_int  (batch, p->size_package);
+    batch_int  (batch, p->size_installed);
+    batch_int  (batch, p->size_archive);
+    batch_package_text (batch, 22, p->location_href);
+    batch_package_text (batch, 23, p->location_base);
+    batch_package_text (batch, 24, p->checksum_type);
+    batch_row_done (batch);
+}
+
+YumDbBatch *
+yum_db_dependency_prepare (sqlite3 *db,
+                           const char *table,
+                           YumDbLayout *layout,
+                           GError **err)
+{
+    YumDbBatch *batch;
+    GString *columns;
+    char *real_table;
+    int n_columns;
+
+    columns = g_string_new (layout->dep_names ? "name_id" : "name");
+    g_string_append (columns, ", flags, epoch, version, release, pkgKey");
+    n_columns = 6;
+
+    if (!strcmp (table, "requires")) {
+        g_string_append (columns, ", pre");
+        n_columns = 7;
+    }
+
+    real_table = yum_db_layout_table (layout, table);
+    batch = yum_db_batch_new (db, real_table, columns->str, n_columns, 0, err);
+    if (batch)
+        batch->layout = layout;
+
+    g_free (real_table);
+    g_string_free (columns, TRUE);
+
+    return batch;
+}
+
+void
+yum_db_dependency_write (sqlite3 *db,
+                         YumDbBatch *batch,
+                         gint64 pkgKey,
+                         Dependency *dep,
+                         gboolean isRequirement)
+{
+    YumDbLayout *layout = batch->layout;
+    int flags = 0;
+
+    if (layout->dep_names && dep->name)
+        batch_int (batch, yum_db_names_intern (layout->dep_names, dep->name));
+    else
+        batch_text (batch, dep->name);
+    if (layout->compact && dep->flags)
+        flags = dep_flags_id (dep->flags);
+    if (flags)
+        batch_int (batch, flags);
+    else
+        batch_text (batch, dep->flags);
+    batch_text (batch, dep->epoch);
+    batch_text (batch, dep->version);
+    batch_text (batch, dep->release);
+    batch_int  (batch, pkgKey);
+
+    if (isRequirement) {
+        if (layout->compact)
+            batch_int (batch, dep->pre ? 1 : 0);
+        else
+            batch_text (batch, dep->pre ? "TRUE" : "FALSE");
+    }
+
+    batch_row_done (batch);
+}
+
+YumDbBatch *
+yum_db_file_prepare (sqlite3 *db, GError **err)
+{
+    return yum_db_batch_new (db, "files", "name, type, pkgKey", 3, 0, err);
+}
+
+void
+yum_db_file_write (sqlite3 *db,
+                   YumDbBatch *batch,
+                   gint64 pkgKey,
+                   PackageFile *file)
+{
+    batch_text (batch, file->name);
+    batch_text (batch, file->type);
+    batch_int  (batch, pkgKey);
+    batch_row_done (batch);
+}
+
+/*  Every file of the filelists by yum_db_path_hash () of its full path,
+ * for yum_db_lookup_paths (). type is the file's filetypes letter. */
+static void
+yum_db_create_filepaths_table (sqlite3 *db, GError **err)
+{
+    int rc;
+    const char *sql;
+
+    sql =
+        "CREATE TABLE filepaths ("
+        "  hash INTEGER,"
+        "  pkgKey INTEGER,"
+        "  type TEXT)";
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create filepaths table: %s",
+                     sqlite3_errmsg (db));
+}
+
+void
+yum_db_create_filelist_tables (sqlite3 *db,
+                               const YumDbOptions *options,
+                               GError **err)
+{
+    int rc;
+    char *sql;
+    const char *filenames_type = "TEXT";
+    gboolean code_files;
+
+    yum_db_create_package_ids_table (db, options, err);
+    if (*err)
+        return;
+
+    if (options->normalize_dirs) {
+        yum_db_create_dirs_table (db, err);
+        if (*err)
+            return;
+    }
+
+    if (options->path_index) {
+        yum_db_create_filepaths_table (db, err);
+        if (*err)
+            return;
+    }
+
+    code_files = options->front_code_files || options->compress_files;
+    if (options->compress_files) {
+        if (yum_filenames_can_compress ())
+            filenames_type = FILENAMES_COMPRESSED;
+        else {
+            g_warning ("Built without zstd, only front coding filenames");
+            filenames_type = FILENAMES_FRONT_CODED;
+        }
+    } else if (code_files)
+        filenames_type = FILENAMES_FRONT_CODED;
+
+    if (!options->normalize_dirs && !code_files) {
+        rc = sqlite3_exec (db,
+                           "CREATE TABLE filelist ("
+                           "  pkgKey INTEGER,"
+                           "  dirname TEXT,"
+                           "  filenames TEXT,"
+                           "  filetypes TEXT)",
+                           NULL, NULL, NULL);
+        if (rc != SQLITE_OK)
+            g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                         "Can not create filelist table: %s",
+                         sqlite3_errmsg (db));
+        return;
+    }
+
+    sql = g_strdup_printf ("CREATE TABLE filelist_data ("
+                           "  pkgKey INTEGER,"
+                           "  %s,"
+                           "  filenames %s,"
+                           "  filetypes TEXT)",
+                           options->normalize_dirs ?
+                           "dirname_id INTEGER" : "dirname TEXT",
+                           filenames_type);
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    g_free (sql);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create filelist_data table: %s",
+                     sqlite3_errmsg (db));
+        return;
+    }
+
+    /*  Coded filenames go through ymp_filenames (), which readers get from
+     * sqlitecachec.open_database (). */
+    sql = g_strdup_printf ("CREATE VIEW filelist AS"
+                           "  SELECT pkgKey, %s AS dirname, %s AS filenames,"
+                           "    filetypes"
+                           "  FROM filelist_data%s",
+                           options->normalize_dirs ? "dirs.path" : "dirname",
+                           code_files ?
+                           "ymp_filenames (filenames)" : "filenames",
+                           options->normalize_dirs ?
+                           " JOIN dirs ON dirs.id = filelist_data.dirname_id" :
+                           "");
+    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    g_free (sql);
+    if (rc != SQLITE_OK)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not create filelist view: %s",
+                     sqlite3_errmsg (db));
+}
+
+void
+yum_db_create_filelist_triggers (sqlite3 *db, GError **err)
+{
+    yum_db_create_removal_trigger (db, "remove_filelist",
+                                   filelist_package_tables, err);
+}
+
+void
+yum_db_index_filelist_tables (sqlite3 *db, GError **err)
+{
+    yum_db_create_index (db, "keyfile", "filelist", "pkgKey", err);
+    if (*err)
+        return;
+
+    yum_db_create_pkgid_index (db, "pkgId", err);
+    if (*err)
+        return;
+
+    if (yum_db_table_exists (db, "filepaths")) {
+        yum_db_create_index (db, "filepathhash", "filepaths", "hash", err);
+        if (*err)
+            return;
+    }
+
+    if (yum_db_table_exists (db, "dirs")) {
+        yum_db_create_index (db, "dirnames", "filelist", "dirname_id", err);
+        if (*err)
             return;
-        }
 
-        if (i < 2) {
-            query = g_strdup_printf(nameindexsql, deps[i], deps[i]);
-            rc = sqlite3_exec (db, query, NULL, NULL, NULL);
-            if (rc != SQLITE_OK) {
-                g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                             "Can not create %sname index: %s",
-                             deps[i], sqlite3_errmsg (db));
-                return;
-            }
-        }
-    }
+        yum_db_index_dirs (db, err);
+    } else
+        yum_db_create_index (db, "dirnames", "filelist", "dirname", err);
 }
 
 sqlite3_stmt *
-yum_db_package_prepare (sqlite3 *db, GError **err)
+yum_db_package_ids_prepare (sqlite3 *db, YumDbLayout *layout, GError **err)
 {
     int rc;
     sqlite3_stmt *handle = NULL;
-    const char *query;
-
-    query =
-        "INSERT INTO packages ("
-        "  pkgId, name, arch, version, epoch, release, summary, description,"
-        "  url, time_file, time_build, rpm_license, rpm_vendor, rpm_group,"
-        "  rpm_buildhost, rpm_sourcerpm, rpm_header_start, rpm_header_end,"
-        "  rpm_packager, size_package, size_installed, size_archive,"
-        "  location_href, location_base, checksum_type) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?,"
-        "  ?, ?, ?, ?, ?, ?, ?)";
+    char *query;
 
+    query = g_strdup_printf ("INSERT INTO %s (pkgId) VALUES (?)",
+                             layout->compact ? "packages_data" : "packages");
     rc = sqlite3_prepare (db, query, -1, &handle, NULL);
+    g_free (query);
     if (rc != SQLITE_OK) {
         g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not prepare packages insertion: %s",
+                     "Can not prepare package ids insertion: %s",
                      sqlite3_errmsg (db));
         sqlite3_finalize (handle);
         handle = NULL;
@@ -527,36 +3331,14 @@ yum_db_package_prepare (sqlite3 *db, GError **err)
 }
 
 void
-yum_db_package_write (sqlite3 *db, sqlite3_stmt *handle, Package *p)
+yum_db_package_ids_write (sqlite3 *db,
+                          sqlite3_stmt *handle,
+                          YumDbLayout *layout,
+                          Package *p)
 {
     int rc;
 
-    sqlite3_bind_text (handle, 1,  p->pkgId, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 2,  p->name, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 3,  p->arch, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 4,  p->version, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 5,  p->epoch, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 6,  p->release, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 7,  p->summary, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 8,  p->description, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 9,  p->url, -1, SQLITE_STATIC);
-    sqlite3_bind_int  (handle, 10, p->time_file);
-    sqlite3_bind_int  (handle, 11, p->time_build);
-    sqlite3_bind_text (handle, 12, p->rpm_license, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 13, p->rpm_vendor, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 14, p->rpm_group, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 15, p->rpm_buildhost, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 16, p->rpm_sourcerpm, -1, SQLITE_STATIC);
-    sqlite3_bind_int  (handle, 17, p->rpm_header_start);
-    sqlite3_bind_int  (handle, 18, p->rpm_header_end);
-    sqlite3_bind_text (handle, 19, p->rpm_packager, -1, SQLITE_STATIC);
-    sqlite3_bind_int64  (handle, 20, p->size_package);
-    sqlite3_bind_int64  (handle, 21, p->size_installed);
-    sqlite3_bind_int64  (handle, 22, p->size_archive);
-    sqlite3_bind_text (handle, 23, p->location_href, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 24, p->location_base, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 25, p->checksum_type, -1, SQLITE_STATIC);
-
+    bind_pkgid (handle, 1, layout, p);
     rc = sqlite3_step (handle);
     sqlite3_reset (handle);
 
@@ -567,313 +3349,395 @@ yum_db_package_write (sqlite3 *db, sqlite3_stmt *handle, Package *p)
         p->pkgKey = sqlite3_last_insert_rowid (db);
 }
 
-sqlite3_stmt *
-yum_db_dependency_prepare (sqlite3 *db,
-                           const char *table,
-                           GError **err)
+YumDbBatch *
+yum_db_filelists_prepare (sqlite3 *db, YumDbLayout *layout, GError **err)
 {
-    int rc;
-    sqlite3_stmt *handle = NULL;
-    char *query;
+    YumDbBatch *batch;
+
+    if (!layout->dirs && !layout->code_files)
+        return yum_db_batch_new (db, "filelist",
+                                 "pkgKey, dirname, filenames, filetypes", 4, 1,
+                                 err);
+
+    batch = yum_db_batch_new (db, "filelist_data",
+                              layout->dirs ?
+                              "pkgKey, dirname_id, filenames, filetypes" :
+                              "pkgKey, dirname, filenames, filetypes", 4, 1,
+                              err);
+    if (batch)
+        batch->layout = layout;
+
+    return batch;
+}
 
-    const char *pre_name = "";
-    const char *pre_value = "";
+static void
+write_file (YumDbBatch *batch, gint64 pkgKey, EncodedPackageFile *file)
+{
+    YumDbLayout *layout = batch->layout;
+
+    batch_int  (batch, pkgKey);
+    if (layout && layout->dirs)
+        batch_int (batch, yum_db_names_intern_len (layout->dirs, file->dir,
+                                                   file->dir_len));
+    else
+        batch_text_len (batch, file->dir, file->dir_len);
+
+    /*  Names that do not get any shorter coded, typically a lone file in
+     * its directory, stay TEXT, which ymp_filenames () passes through. */
+    if (layout && layout->code_files) {
+        yum_filenames_encode (file->files->str, file->files->len,
+                              layout->compress_files, layout->files);
+        if (layout->files->len < file->files->len) {
+            layout->files_saved += file->files->len - layout->files->len;
+            batch_blob (batch, (const guchar *) layout->files->str,
+                        layout->files->len);
+        } else
+            batch_text_len (batch, file->files->str, file->files->len);
+    } else
+        batch_text_len (batch, file->files->str, file->files->len);
+    batch_text_len (batch, file->types->str, file->types->len);
+    batch_row_done (batch);
+}
 
-    if (!strcmp (table, "requires")) {
-        pre_name = ", pre";
-        pre_value = ", ?";
-    }
+void
+yum_db_filelists_write (sqlite3 *db, YumDbBatch *batch, Package *p)
+{
+    FilesEncoder *enc;
+    GSList *iter;
+    guint i;
 
-    query = g_strdup_printf
-        ("INSERT INTO %s (name, flags, epoch, version, release, pkgKey%s) "
-         "VALUES (?, ?, ?, ?, ?, ?%s)", table, pre_name, pre_value);
+    if (!batch->files)
+        batch->files = files_encoder_new ();
+    enc = batch->files;
 
-    rc = sqlite3_prepare (db, query, -1, &handle, NULL);
-    g_free (query);
+    files_encoder_reset (enc);
+    for (iter = p->files; iter; iter = iter->next)
+        files_encoder_add (enc, (PackageFile *) iter->data);
 
-    if (rc != SQLITE_OK) {
-        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not prepare dependency insertion: %s",
-                     sqlite3_errmsg (db));
-        sqlite3_finalize (handle);
-        handle = NULL;
-    }
+    for (i = 0; i < enc->n_dirs; i++)
+        write_file (batch, p->pkgKey, g_ptr_array_index (enc->dirs, i));
+}
 
-    return handle;
+YumDbBatch *
+yum_db_filepaths_prepare (sqlite3 *db, YumDbLayout *layout, GError **err)
+{
+    if (!layout->path_index)
+        return NULL;
+
+    return yum_db_batch_new (db, "filepaths", "hash, pkgKey, type", 3, 0, err);
 }
 
 void
-yum_db_dependency_write (sqlite3 *db,
-                         sqlite3_stmt *handle,
-                         gint64 pkgKey,
-                         Dependency *dep,
-                         gboolean isRequirement)
+yum_db_filepaths_write (sqlite3 *db, YumDbBatch *batch, Package *p)
 {
-    int rc;
+    PackageFile *file;
+    GSList *iter;
+    char type;
 
-    sqlite3_bind_text (handle, 1, dep->name,    -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 2, dep->flags,   -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 3, dep->epoch,   -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 4, dep->version, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 5, dep->release, -1, SQLITE_STATIC);
-    sqlite3_bind_int  (handle, 6, pkgKey);
+    for (iter = p->files; iter; iter = iter->next) {
+        file = (PackageFile *) iter->data;
 
-    if (isRequirement) {
-        if (dep->pre)
-            sqlite3_bind_text (handle, 7, "TRUE", -1, SQLITE_TRANSIENT);
-        else
-            sqlite3_bind_text (handle, 7, "FALSE", -1, SQLITE_TRANSIENT);
-    }
+        type = file_type_char (file->type);
+        if (!type)
+            continue;
 
-    rc = sqlite3_step (handle);
-    sqlite3_reset (handle);
+        batch_int      (batch, yum_db_path_hash (file->name,
+                                                 strlen (file->name)));
+        batch_int      (batch, p->pkgKey);
+        batch_text_len (batch, &type, 1);
+        batch_row_done (batch);
+    }
+}
 
-    if (rc != SQLITE_DONE)
-        g_critical ("Error adding dependency to SQL: %s",
-                    sqlite3_errmsg (db));
+/* yum_hash_fnv1a () of path, the key of the filepaths table */
+gint64
+yum_db_path_hash (const char *path, gsize len)
+{
+    return (gint64) yum_hash_fnv1a (path, len);
 }
 
-sqlite3_stmt *
-yum_db_file_prepare (sqlite3 *db, GError **err)
+/*  Looks up the packages owning each of the n_paths paths through the
+ * filepaths table, calling fn for every (path, package) pair. Hash matches
+ * are checked against the package's filelist row, so a collision can
+ * not report a file a package does not have. */
+void
+yum_db_lookup_paths (sqlite3 *db,
+                     const char **paths,
+                     guint n_paths,
+                     YumDbPathFn fn,
+                     gpointer user_data,
+                     GError **err)
 {
+    sqlite3_stmt *hash_handle = NULL;
+    sqlite3_stmt *names_handle = NULL;
+    const char *dir;
+    const char *base;
+    int dir_len;
+    int base_len;
+    gint64 pkgKey;
+    const char *type;
+    gboolean found;
+    guint i;
     int rc;
-    sqlite3_stmt *handle = NULL;
-    const char *query;
-
-    query = "INSERT INTO files (name, type, pkgKey) VALUES (?, ?, ?)";
 
-    rc = sqlite3_prepare (db, query, -1, &handle, NULL);
+    rc = sqlite3_prepare (db,
+                          "SELECT pkgKey, type FROM filepaths WHERE hash = ?",
+                          -1, &hash_handle, NULL);
+    /*  Through a package's few rows rather than a directory's many, which
+     * the planner would pick for the dirs view without the '+'. */
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare (db,
+                              "SELECT filenames FROM filelist"
+                              "  WHERE pkgKey = ? AND +dirname = ?",
+                              -1, &names_handle, NULL);
     if (rc != SQLITE_OK) {
         g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not prepare file insertion: %s",
+                     "Can not prepare path lookup: %s",
                      sqlite3_errmsg (db));
-        sqlite3_finalize (handle);
-        handle = NULL;
+        goto cleanup;
     }
 
-    return handle;
+    for (i = 0; i < n_paths; i++) {
+        split_path (paths[i], &dir, &dir_len, &base, &base_len);
+
+        sqlite3_bind_int64 (hash_handle, 1,
+                            yum_db_path_hash (paths[i], strlen (paths[i])));
+        while (sqlite3_step (hash_handle) == SQLITE_ROW) {
+            pkgKey = sqlite3_column_int64 (hash_handle, 0);
+            type = (const char *) sqlite3_column_text (hash_handle, 1);
+
+            sqlite3_bind_int64 (names_handle, 1, pkgKey);
+            sqlite3_bind_text (names_handle, 2, dir, dir_len, SQLITE_STATIC);
+            found = FALSE;
+            while (!found && sqlite3_step (names_handle) == SQLITE_ROW) {
+                found = yum_filenames_contain
+                    ((const char *) sqlite3_column_text (names_handle, 0),
+                     sqlite3_column_bytes (names_handle, 0),
+                     base, base_len);
+            }
+            sqlite3_reset (names_handle);
+
+            if (found)
+                fn (i, pkgKey, type ? type[0] : 0, user_data);
+        }
+        sqlite3_reset (hash_handle);
+    }
 
+ cleanup:
+    sqlite3_finalize (hash_handle);
+    sqlite3_finalize (names_handle);
 }
 
+/*  The SQL functions the views of some layouts call, for connections
+ * reading a database from C. */
 void
-yum_db_file_write (sqlite3 *db,
-                   sqlite3_stmt *handle,
-                   gint64 pkgKey,
-                   PackageFile *file)
+yum_db_register_functions (sqlite3 *db)
 {
-    int rc;
+    ymp_sqlite_register (db);
+}
 
-    sqlite3_bind_text (handle, 1, file->name, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 2, file->type, -1, SQLITE_STATIC);
-    sqlite3_bind_int  (handle, 3, pkgKey);
+/* Runs a single number query, -1 on errors */
+static gint64
+yum_db_count (sqlite3 *db, const char *sql)
+{
+    sqlite3_stmt *handle = NULL;
+    gint64 count = -1;
 
-    rc = sqlite3_step (handle);
-    sqlite3_reset (handle);
+    if (sqlite3_prepare (db, sql, -1, &handle, NULL) == SQLITE_OK &&
+        sqlite3_step (handle) == SQLITE_ROW)
+        count = sqlite3_column_int64 (handle, 0);
+    sqlite3_finalize (handle);
 
-    if (rc != SQLITE_DONE)
-        g_critical ("Error adding package file to SQL: %s",
-                    sqlite3_errmsg (db));
+    return count;
 }
 
-void
-yum_db_create_filelist_tables (sqlite3 *db, GError **err)
+/* Adds every full path of the filelist rows to bloom */
+static void
+bloom_add_filelist (sqlite3 *db, YumBloom *bloom, GError **err)
 {
+    sqlite3_stmt *handle = NULL;
+    YumFilenamesIter iter;
+    GString *path;
+    const char *name;
+    gsize name_len;
+    gsize dir_len;
     int rc;
-    const char *sql;
 
-    sql =
-        "CREATE TABLE packages ("
-        "  pkgKey INTEGER PRIMARY KEY,"
-        "  pkgId TEXT)";
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    rc = sqlite3_prepare (db, "SELECT dirname, filenames FROM filelist",
+                          -1, &handle, NULL);
     if (rc != SQLITE_OK) {
         g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create packages table: %s",
-                     sqlite3_errmsg (db));
+                     "Can not prepare filter keys: %s", sqlite3_errmsg (db));
         return;
     }
 
-    sql =
-        "CREATE TABLE filelist ("
-        "  pkgKey INTEGER,"
-        "  dirname TEXT,"
-        "  filenames TEXT,"
-        "  filetypes TEXT)";
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create filelist table: %s",
-                     sqlite3_errmsg (db));
-        return;
+    path = g_string_sized_new (256);
+    while ((rc = sqlite3_step (handle)) == SQLITE_ROW) {
+        yum_filenames_iter_init (&iter,
+                                 (const char *) sqlite3_column_text (handle, 1),
+                                 sqlite3_column_bytes (handle, 1));
+
+        g_string_assign (path, (const char *) sqlite3_column_text (handle, 0));
+        if (path->len && path->str[path->len - 1] != '/')
+            g_string_append_c (path, '/');
+        dir_len = path->len;
+
+        while (yum_filenames_iter_next (&iter, &name, &name_len)) {
+            g_string_append_len (path, name, name_len);
+            yum_bloom_add (bloom, path->str, path->len);
+            g_string_truncate (path, dir_len);
+        }
     }
+    g_string_free (path, TRUE);
 
-    sql =
-        "CREATE TRIGGER remove_filelist AFTER DELETE ON packages"
-        "  BEGIN"
-        "    DELETE FROM filelist WHERE pkgKey = old.pkgKey;"
-        "  END;";
-
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
+    if (rc != SQLITE_DONE)
         g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create remove_filelist trigger: %s",
-                     sqlite3_errmsg (db));
-        return;
-    }
+                     "Can not read filter keys: %s", sqlite3_errmsg (db));
+    sqlite3_finalize (handle);
 }
 
-void
-yum_db_index_filelist_tables (sqlite3 *db, GError **err)
+/* Adds the text of the one column sql selects to bloom */
+static void
+bloom_add_query (sqlite3 *db, YumBloom *bloom, const char *sql, GError **err)
 {
+    sqlite3_stmt *handle = NULL;
     int rc;
-    const char *sql;
 
-    sql = "CREATE INDEX IF NOT EXISTS keyfile ON filelist (pkgKey)";
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
+    rc = sqlite3_prepare (db, sql, -1, &handle, NULL);
     if (rc != SQLITE_OK) {
         g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create keyfile index: %s",
-                     sqlite3_errmsg (db));
+                     "Can not prepare filter keys: %s", sqlite3_errmsg (db));
         return;
     }
 
-    sql = "CREATE INDEX IF NOT EXISTS pkgId ON packages (pkgId)";
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create pkgId index: %s",
-                     sqlite3_errmsg (db));
-        return;
-    }
+    while ((rc = sqlite3_step (handle)) == SQLITE_ROW)
+        yum_bloom_add (bloom, (const char *) sqlite3_column_text (handle, 0),
+                       sqlite3_column_bytes (handle, 0));
 
-    sql = "CREATE INDEX IF NOT EXISTS dirnames ON filelist (dirname)";
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
+    if (rc != SQLITE_DONE)
         g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create dirnames index: %s",
-                     sqlite3_errmsg (db));
-        return;
-    }
+                     "Can not read filter keys: %s", sqlite3_errmsg (db));
+    sqlite3_finalize (handle);
 }
 
-sqlite3_stmt *
-yum_db_package_ids_prepare (sqlite3 *db, GError **err)
+/*  Writes the YumDbOptions.bloom_filter sidecar of db to path: a Bloom
+ * filter over the provides names and file paths of a primary cache, or
+ * the file paths of a filelists one. Read from the finished cache, so
+ * in-place updates get a complete filter too. FALSE if db is neither, or
+ * on errors. */
+gboolean
+yum_db_write_bloom (sqlite3 *db, const char *path, GError **err)
 {
-    int rc;
-    sqlite3_stmt *handle = NULL;
-    const char *query;
-
-    query = "INSERT INTO packages (pkgId) VALUES (?)";
-    rc = sqlite3_prepare (db, query, -1, &handle, NULL);
-    if (rc != SQLITE_OK) {
+    YumBloom *bloom;
+    gint64 n_keys;
+    gboolean primary;
+
+    primary = yum_db_table_exists (db, "provides") ||
+        yum_db_table_exists (db, "provides_data");
+    if (!primary && !yum_db_table_exists (db, "filelist") &&
+        !yum_db_table_exists (db, "filelist_data"))
+        return FALSE;
+
+    /* For the views of the front_code_files layout */
+    yum_db_register_functions (db);
+
+    if (primary)
+        n_keys = yum_db_count (db, "SELECT (SELECT count(*) FROM provides) +"
+                               "  (SELECT count(*) FROM files)");
+    else
+        n_keys = yum_db_count (db, "SELECT sum(length(filetypes))"
+                               "  FROM filelist");
+    if (n_keys < 0) {
         g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not prepare package ids insertion: %s",
-                     sqlite3_errmsg (db));
-        sqlite3_finalize (handle);
-        handle = NULL;
+                     "Can not size filter: %s", sqlite3_errmsg (db));
+        return FALSE;
     }
 
-    return handle;
-}
-
-void
-yum_db_package_ids_write (sqlite3 *db, sqlite3_stmt *handle, Package *p)
-{
-    int rc;
+    bloom = yum_bloom_new (n_keys);
+    if (primary) {
+        bloom_add_query (db, bloom, "SELECT name FROM provides", err);
+        if (!*err)
+            bloom_add_query (db, bloom, "SELECT name FROM files", err);
+    } else
+        bloom_add_filelist (db, bloom, err);
 
-    sqlite3_bind_text (handle, 1,  p->pkgId, -1, SQLITE_STATIC);
-    rc = sqlite3_step (handle);
-    sqlite3_reset (handle);
+    if (!*err)
+        yum_bloom_write (bloom, path, err);
+    yum_bloom_free (bloom);
 
-    if (rc != SQLITE_DONE) {
-        g_critical ("Error adding package to SQL: %s",
-                    sqlite3_errmsg (db));
-    } else
-        p->pkgKey = sqlite3_last_insert_rowid (db);
+    return !*err;
 }
 
-sqlite3_stmt *
-yum_db_filelists_prepare (sqlite3 *db, GError **err)
+/* Adds the (name, pkgKey) rows sql selects to table of builder */
+static void
+hash_index_add_query (sqlite3 *db,
+                      YumHashIndexBuilder *builder,
+                      YumHashIndexTable table,
+                      const char *sql,
+                      GError **err)
 {
-    int rc;
     sqlite3_stmt *handle = NULL;
-    const char *query;
-
-    query =
-        "INSERT INTO filelist (pkgKey, dirname, filenames, filetypes) "
-        " VALUES (?, ?, ?, ?)";
+    int rc;
 
-    rc = sqlite3_prepare (db, query, -1, &handle, NULL);
+    rc = sqlite3_prepare (db, sql, -1, &handle, NULL);
     if (rc != SQLITE_OK) {
         g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not prepare filelist insertion: %s",
-                     sqlite3_errmsg (db));
-        sqlite3_finalize (handle);
-        handle = NULL;
+                     "Can not prepare index keys: %s", sqlite3_errmsg (db));
+        return;
     }
 
-    return handle;
-}
-
-typedef struct {
-    sqlite3 *db;
-    sqlite3_stmt *handle;
-    gint64 pkgKey;
-} FileWriteInfo;
-
-static void
-write_file (gpointer key, gpointer value, gpointer user_data)
-{
-    EncodedPackageFile *file = (EncodedPackageFile *) value;
-    FileWriteInfo *info = (FileWriteInfo *) user_data;
-    int rc;
-
-    sqlite3_bind_int  (info->handle, 1, info->pkgKey);
-    sqlite3_bind_text (info->handle, 2, (const char *) key, -1, SQLITE_STATIC);
-    sqlite3_bind_text (info->handle, 3, file->files->str, -1, SQLITE_STATIC);
-    sqlite3_bind_text (info->handle, 4, file->types->str, -1, SQLITE_STATIC);
+    while ((rc = sqlite3_step (handle)) == SQLITE_ROW)
+        yum_hash_index_builder_add (builder, table,
+                                    (const char *) sqlite3_column_text (handle, 0),
+                                    sqlite3_column_bytes (handle, 0),
+                                    sqlite3_column_int64 (handle, 1));
 
-    rc = sqlite3_step (info->handle);
-    sqlite3_reset (info->handle);
-
-    if (rc != SQLITE_DONE) {
-        g_critical ("Error adding file to SQL: %s",
-                    sqlite3_errmsg (info->db));
-    }
+    if (rc != SQLITE_DONE)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not read index keys: %s", sqlite3_errmsg (db));
+    sqlite3_finalize (handle);
 }
 
-void
-yum_db_filelists_write (sqlite3 *db, sqlite3_stmt *handle, Package *p)
+/*  Writes the YumDbOptions.hash_index sidecar of a primary db to path:
+ * the pkgKeys of every provides name and package name, see
+ * yum_hash_index_lookup (). FALSE if db is not a primary cache, or on
+ * errors. */
+gboolean
+yum_db_write_hash_index (sqlite3 *db, const char *path, GError **err)
 {
-    GHashTable *hash;
-    FileWriteInfo info;
-
-    info.db = db;
-    info.handle = handle;
-    info.pkgKey = p->pkgKey;
-
-    hash = package_files_to_hash (p->files);
-    g_hash_table_foreach (hash, write_file, &info);
-    g_hash_table_destroy (hash);
+    YumHashIndexBuilder *builder;
+
+    if (!yum_db_table_exists (db, "provides") &&
+        !yum_db_table_exists (db, "provides_data"))
+        return FALSE;
+
+    builder = yum_hash_index_builder_new ();
+    hash_index_add_query (db, builder, YUM_HASH_INDEX_PROVIDES,
+                          "SELECT name, pkgKey FROM provides"
+                          "  ORDER BY name, pkgKey", err);
+    if (!*err)
+        hash_index_add_query (db, builder, YUM_HASH_INDEX_PACKAGES,
+                              "SELECT name, pkgKey FROM packages"
+                              "  ORDER BY name, pkgKey", err);
+
+    if (!*err)
+        yum_hash_index_builder_write (builder, path, err);
+    yum_hash_index_builder_free (builder);
+
+    return !*err;
 }
 
 void
-yum_db_create_other_tables (sqlite3 *db, GError **err)
+yum_db_create_other_tables (sqlite3 *db,
+                            const YumDbOptions *options,
+                            GError **err)
 {
     int rc;
     const char *sql;
 
-    sql =
-        "CREATE TABLE packages ("
-        "  pkgKey INTEGER PRIMARY KEY,"
-        "  pkgId TEXT)";
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create packages table: %s",
-                     sqlite3_errmsg (db));
+    yum_db_create_package_ids_table (db, options, err);
+    if (*err)
         return;
-    }
 
     sql =
         "CREATE TABLE changelog ("
@@ -888,91 +3752,46 @@ yum_db_create_other_tables (sqlite3 *db, GError **err)
                      sqlite3_errmsg (db));
         return;
     }
+}
 
-    sql =
-        "CREATE TRIGGER remove_changelogs AFTER DELETE ON packages"
-        "  BEGIN"
-        "    DELETE FROM changelog WHERE pkgKey = old.pkgKey;"
-        "  END;";
-
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create remove_changelogs trigger: %s",
-                     sqlite3_errmsg (db));
-        return;
-    }
+void
+yum_db_create_other_triggers (sqlite3 *db, GError **err)
+{
+    yum_db_create_removal_trigger (db, "remove_changelogs",
+                                   other_package_tables, err);
 }
 
 void
 yum_db_index_other_tables (sqlite3 *db, GError **err)
 {
-    int rc;
-    const char *sql;
-
-    sql = "CREATE INDEX IF NOT EXISTS keychange ON changelog (pkgKey)";
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create keychange index: %s",
-                     sqlite3_errmsg (db));
+    yum_db_create_index (db, "keychange", "changelog", "pkgKey", err);
+    if (*err)
         return;
-    }
 
-    sql = "CREATE INDEX IF NOT EXISTS pkgId ON packages (pkgId)";
-    rc = sqlite3_exec (db, sql, NULL, NULL, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not create pkgId index: %s",
-                     sqlite3_errmsg (db));
-        return;
-    }
+    yum_db_create_pkgid_index (db, "pkgId", err);
 }
 
-sqlite3_stmt *
+YumDbBatch *
 yum_db_changelog_prepare (sqlite3 *db, GError **err)
 {
-    int rc;
-    sqlite3_stmt *handle = NULL;
-    const char *query;
-
-    query =
-        "INSERT INTO changelog (pkgKey, author, date, changelog) "
-        " VALUES (?, ?, ?, ?)";
-
-    rc = sqlite3_prepare (db, query, -1, &handle, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not prepare changelog insertion: %s",
-                     sqlite3_errmsg (db));
-        sqlite3_finalize (handle);
-        handle = NULL;
-    }
-
-    return handle;
+    return yum_db_batch_new (db, "changelog",
+                             "pkgKey, author, date, changelog", 4, -1,
+                             err);
 }
 
 void
-yum_db_changelog_write (sqlite3 *db, sqlite3_stmt *handle, Package *p)
+yum_db_changelog_write (sqlite3 *db, YumDbBatch *batch, Package *p)
 {
     GSList *iter;
     ChangelogEntry *entry;
-    int rc;
 
     for (iter = p->changelogs; iter; iter = iter->next) {
         entry = (ChangelogEntry *) iter->data;
 
-        sqlite3_bind_int  (handle, 1, p->pkgKey);
-        sqlite3_bind_text (handle, 2, entry->author, -1, SQLITE_STATIC);
-        sqlite3_bind_int  (handle, 3, entry->date);
-        sqlite3_bind_text (handle, 4, entry->changelog, -1, SQLITE_STATIC);
-
-        rc = sqlite3_step (handle);
-        sqlite3_reset (handle);
-
-        if (rc != SQLITE_DONE) {
-            g_critical ("Error adding changelog to SQL: %s",
-                        sqlite3_errmsg (db));
-        }
+        batch_int  (batch, p->pkgKey);
+        batch_text (batch, entry->author);
+        batch_int  (batch, entry->date);
+        batch_text (batch, entry->changelog);
+        batch_row_done (batch);
     }
 }
@@ -27,12 +27,64 @@
 #define YUM_DB_ERROR yum_db_error_quark()
 GQuark yum_db_error_quark (void);
 
-typedef void (*CreateTablesFn) (sqlite3 *db, GError **err);
+/* Multi-row inserter handed out by the *_prepare functions below */
+typedef struct _YumDbBatch YumDbBatch;
+
+/* How a database lays out its tables, see yum_db_layout_open () */
+typedef struct _YumDbLayout YumDbLayout;
+
+/* Knobs for building a cache, filled in from the Python options dict */
+typedef struct {
+    /* Build in memory when the metadata is at most this many bytes once
+     * uncompressed, which is about what the database takes */
+    gint64 memory_limit;
+    /* Insert child table rows ordered by their lookup key */
+    gboolean sorted_load;
+    /* Write each primary table from a thread of its own on fresh builds */
+    gboolean parallel;
+    /* Keep dependency names once in depnames, see yum_db_layout_open () */
+    gboolean normalize_deps;
+    /* Binary pkgIds, integer flags and pre, checksum types by id */
+    gboolean compact_types;
+    /* Keep vendors, licenses, urls etc. once, referred to by id */
+    gboolean dictionary_columns;
+    /* Keep filelists directories once in dirs, referred to by id */
+    gboolean normalize_dirs;
+    /* Front code filelist filenames, see yum_filenames_encode () */
+    gboolean front_code_files;
+    /* Also zstd compress them, implies front_code_files */
+    gboolean compress_files;
+    /* Index filelists by full path, see yum_db_lookup_paths () */
+    gboolean path_index;
+    /* FTS5 index of summaries and descriptions, yum_db_search_packages () */
+    gboolean search_index;
+    /* Write a Bloom filter of provides and files next to the cache */
+    gboolean bloom_filter;
+    /* Write a hash index of provides and package names next to the cache */
+    gboolean hash_index;
+    /* nevra and evr sort key columns in packages, see yum_evr_sort_key () */
+    gboolean evr_columns;
+    /* Tables of the newest packages, source rpms and arches by name */
+    gboolean summary_tables;
+} YumDbOptions;
+
+typedef void (*CreateTablesFn) (sqlite3 *db,
+                                const YumDbOptions *options,
+                                GError **err);
+
+void          yum_db_options_init           (YumDbOptions *options);
 
 char         *yum_db_filename               (const char *prefix);
 sqlite3      *yum_db_open                   (const char *path,
                                              const char *checksum,
                                              CreateTablesFn create_tables,
+                                             const YumDbOptions *options,
+                                             gboolean in_memory,
+                                             char **build_path,
+                                             GError **err);
+void          yum_db_close                  (sqlite3 *db,
+                                             const char *path,
+                                             const char *build_path,
                                              GError **err);
 
 void          yum_db_dbinfo_update          (sqlite3 *db,
@@ -41,50 +93,150 @@ void          yum_db_dbinfo_update          (sqlite3 *db,
 
 GHashTable   *yum_db_read_package_ids       (sqlite3 *db, GError **err);
 
+void          yum_db_batch_set_sorted       (YumDbBatch *batch,
+                                             gboolean sorted);
+void          yum_db_batch_flush            (YumDbBatch *batch, GError **err);
+void          yum_db_batch_free             (YumDbBatch *batch);
+
+void          yum_db_batch_start            (YumDbBatch *batch,
+                                             sqlite3 *db,
+                                             GError **err);
+void          yum_db_batch_join             (YumDbBatch *batch, GError **err);
+sqlite3      *yum_db_scratch_open           (sqlite3 *db,
+                                             const char *path,
+                                             const char *table,
+                                             GError **err);
+void          yum_db_merge_table            (sqlite3 *db,
+                                             const char *path,
+                                             const char *table,
+                                             GError **err);
+
+YumDbLayout  *yum_db_layout_open            (sqlite3 *db, GError **err);
+void          yum_db_layout_flush           (YumDbLayout *layout, GError **err);
+void          yum_db_layout_free            (YumDbLayout *layout);
+char         *yum_db_layout_table           (YumDbLayout *layout,
+                                             const char *table);
+
+sqlite3_stmt *yum_db_stale_packages_prepare (sqlite3 *db, GError **err);
+void          yum_db_stale_package_write    (sqlite3 *db,
+                                             sqlite3_stmt *handle,
+                                             gint64 pkgKey);
+
 /* Primary */
 
-void          yum_db_create_primary_tables  (sqlite3 *db, GError **err);
+/* The tables with rows per package, besides packages, NULL terminated */
+#define YUM_DB_N_PRIMARY_PACKAGE_TABLES 5
+extern const char *
+yum_db_primary_package_tables[YUM_DB_N_PRIMARY_PACKAGE_TABLES + 1];
+
+void          yum_db_create_primary_tables  (sqlite3 *db,
+                                             const YumDbOptions *options,
+                                             GError **err);
 void          yum_db_index_primary_tables   (sqlite3 *db, GError **err);
-sqlite3_stmt *yum_db_package_prepare        (sqlite3 *db, GError **err);
+void          yum_db_create_primary_triggers (sqlite3 *db, GError **err);
+
+/* Called by yum_db_search_packages (), the best matches first */
+typedef void (*YumDbSearchFn) (gint64 pkgKey,
+                               double score,
+                               gpointer user_data);
+
+void          yum_db_search_packages        (sqlite3 *db,
+                                             const char *term,
+                                             int limit,
+                                             YumDbSearchFn fn,
+                                             gpointer user_data,
+                                             GError **err);
+void          yum_db_remove_primary_packages (sqlite3 *db, GError **err);
+sqlite3_stmt *yum_db_package_prepare        (sqlite3 *db,
+                                             YumDbLayout *layout,
+                                             GError **err);
 void          yum_db_package_write          (sqlite3 *db,
                                              sqlite3_stmt *handle,
+                                             YumDbLayout *layout,
+                                             Package *p);
+YumDbBatch   *yum_db_package_batch_prepare  (sqlite3 *db,
+                                             YumDbLayout *layout,
+                                             GError **err);
+void          yum_db_package_batch_write    (sqlite3 *db,
+                                             YumDbBatch *batch,
                                              Package *p);
 
-sqlite3_stmt *yum_db_dependency_prepare     (sqlite3 *db,
+YumDbBatch   *yum_db_dependency_prepare     (sqlite3 *db,
                                              const char *table,
+                                             YumDbLayout *layout,
                                              GError **err);
 void          yum_db_dependency_write       (sqlite3 *db,
-                                             sqlite3_stmt *handle,
+                                             YumDbBatch *batch,
                                              gint64 pkgKey,
                                              Dependency *dep,
                                              gboolean isRequirement);
 
-sqlite3_stmt *yum_db_file_prepare           (sqlite3 *db, GError **err);
+YumDbBatch   *yum_db_file_prepare           (sqlite3 *db, GError **err);
 void          yum_db_file_write             (sqlite3 *db,
-                                             sqlite3_stmt *handle,
+                                             YumDbBatch *batch,
                                              gint64 pkgKey,
                                              PackageFile *file);
 
 /* Filelists */
 
-void          yum_db_create_filelist_tables (sqlite3 *db, GError **err);
+void          yum_db_create_filelist_tables (sqlite3 *db,
+                                             const YumDbOptions *options,
+                                             GError **err);
 void          yum_db_index_filelist_tables  (sqlite3 *db, GError **err);
-sqlite3_stmt *yum_db_package_ids_prepare    (sqlite3 *db, GError **err);
+void          yum_db_create_filelist_triggers (sqlite3 *db, GError **err);
+void          yum_db_remove_filelist_packages (sqlite3 *db, GError **err);
+sqlite3_stmt *yum_db_package_ids_prepare    (sqlite3 *db,
+                                             YumDbLayout *layout,
+                                             GError **err);
 void          yum_db_package_ids_write      (sqlite3 *db,
                                              sqlite3_stmt *handle,
+                                             YumDbLayout *layout,
                                              Package *p);
 
-sqlite3_stmt *yum_db_filelists_prepare      (sqlite3 *db, GError **err);
+YumDbBatch   *yum_db_filelists_prepare      (sqlite3 *db,
+                                             YumDbLayout *layout,
+                                             GError **err);
 void          yum_db_filelists_write        (sqlite3 *db,
-                                             sqlite3_stmt *handle,
+                                             YumDbBatch *batch,
+                                             Package *p);
+YumDbBatch   *yum_db_filepaths_prepare      (sqlite3 *db,
+                                             YumDbLayout *layout,
+                                             GError **err);
+void          yum_db_filepaths_write        (sqlite3 *db,
+                                             YumDbBatch *batch,
                                              Package *p);
 
+/* Called by yum_db_lookup_paths () with the index of the path looked up */
+typedef void (*YumDbPathFn) (guint path,
+                             gint64 pkgKey,
+                             char type,
+                             gpointer user_data);
+
+gint64        yum_db_path_hash              (const char *path, gsize len);
+void          yum_db_lookup_paths           (sqlite3 *db,
+                                             const char **paths,
+                                             guint n_paths,
+                                             YumDbPathFn fn,
+                                             gpointer user_data,
+                                             GError **err);
+void          yum_db_register_functions     (sqlite3 *db);
+gboolean      yum_db_write_bloom            (sqlite3 *db,
+                                             const char *path,
+                                             GError **err);
+gboolean      yum_db_write_hash_index       (sqlite3 *db,
+                                             const char *path,
+                                             GError **err);
+
 /* Other */
-void          yum_db_create_other_tables    (sqlite3 *db, GError **err);
+void          yum_db_create_other_tables    (sqlite3 *db,
+                                             const YumDbOptions *options,
+                                             GError **err);
 void          yum_db_index_other_tables     (sqlite3 *db, GError **err);
-sqlite3_stmt *yum_db_changelog_prepare      (sqlite3 *db, GError **err);
+void          yum_db_create_other_triggers (sqlite3 *db, GError **err);
+void          yum_db_remove_other_packages  (sqlite3 *db, GError **err);
+YumDbBatch   *yum_db_changelog_prepare      (sqlite3 *db, GError **err);
 void          yum_db_changelog_write        (sqlite3 *db,
-                                             sqlite3_stmt *handle,
+                                             YumDbBatch *batch,
                                              Package *p);
 
 
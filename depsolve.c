@@ -0,0 +1,412 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <string.h>
+#include "db.h"
+#include "evr.h"
+#include "depsolve.h"
+
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *requires;
+    sqlite3_stmt *provides;
+    sqlite3_stmt *files;
+    sqlite3_stmt *nevra;
+} DepsolveCache;
+
+typedef struct {
+    YumDepsolvePackage package;
+    Dependency provide;
+} Provider;
+
+struct _YumDepsolve {
+    DepsolveCache *caches;
+    guint n_caches;
+    GArray *packages;
+
+    /*  The providers of every name looked up so far, from all the caches.
+     * Most requires are of a few names, libc.so.6 and the like. */
+    GHashTable *providers;
+    GStringChunk *chunk;
+};
+
+static sqlite3_stmt *
+depsolve_prepare (DepsolveCache *cache, const char *sql, GError **err)
+{
+    sqlite3_stmt *handle = NULL;
+
+    if (sqlite3_prepare (cache->db, sql, -1, &handle, NULL) != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not prepare dependency query: %s",
+                     sqlite3_errmsg (cache->db));
+        sqlite3_finalize (handle);
+        return NULL;
+    }
+
+    return handle;
+}
+
+static void
+depsolve_cache_open (DepsolveCache *cache, const char *path, GError **err)
+{
+    if (sqlite3_open_v2 (path, &cache->db, SQLITE_OPEN_READONLY, NULL) !=
+        SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not open %s: %s", path, sqlite3_errmsg (cache->db));
+        return;
+    }
+    yum_db_register_functions (cache->db);
+
+    cache->requires = depsolve_prepare (cache,
+        "SELECT name, flags, epoch, version, release FROM requires"
+        "  WHERE pkgKey = ?", err);
+    if (!*err)
+        cache->provides = depsolve_prepare (cache,
+            "SELECT pkgKey, flags, epoch, version, release FROM provides"
+            "  WHERE name = ?", err);
+    if (!*err)
+        cache->files = depsolve_prepare (cache,
+            "SELECT pkgKey FROM files WHERE name = ?", err);
+    if (!*err)
+        cache->nevra = depsolve_prepare (cache,
+            "SELECT pkgKey FROM packages WHERE name = ? AND version = ?"
+            "  AND release = ? AND arch = ? AND coalesce (epoch, '0') = ?",
+            err);
+}
+
+static void
+depsolve_cache_close (DepsolveCache *cache)
+{
+    sqlite3_finalize (cache->requires);
+    sqlite3_finalize (cache->provides);
+    sqlite3_finalize (cache->files);
+    sqlite3_finalize (cache->nevra);
+    if (cache->db)
+        sqlite3_close (cache->db);
+}
+
+static void
+providers_free (gpointer data)
+{
+    g_array_free ((GArray *) data, TRUE);
+}
+
+YumDepsolve *
+yum_depsolve_new (const char **primaries, guint n_primaries, GError **err)
+{
+    YumDepsolve *depsolve;
+    guint i;
+
+    depsolve = g_new0 (YumDepsolve, 1);
+    depsolve->caches = g_new0 (DepsolveCache, n_primaries);
+    depsolve->n_caches = n_primaries;
+    depsolve->packages = g_array_new (FALSE, FALSE,
+                                      sizeof (YumDepsolvePackage));
+    depsolve->providers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 NULL, providers_free);
+    depsolve->chunk = g_string_chunk_new (16384);
+
+    for (i = 0; i < n_primaries && !*err; i++)
+        depsolve_cache_open (&depsolve->caches[i], primaries[i], err);
+
+    if (*err) {
+        yum_depsolve_free (depsolve);
+        return NULL;
+    }
+
+    return depsolve;
+}
+
+void
+yum_depsolve_add (YumDepsolve *depsolve, guint cache, gint64 pkgKey)
+{
+    YumDepsolvePackage package;
+
+    g_return_if_fail (cache < depsolve->n_caches);
+
+    package.cache = cache;
+    package.pkgKey = pkgKey;
+    g_array_append_val (depsolve->packages, package);
+}
+
+/*  Adds the packages called name-[epoch:]version-release.arch in any of
+ * the caches, returns how many there were. */
+guint
+yum_depsolve_add_nevra (YumDepsolve *depsolve,
+                        const char *nevra,
+                        GError **err)
+{
+    char *name;
+    char *epoch;
+    char *version;
+    char *release;
+    char *arch;
+    char *sep;
+    guint added = 0;
+    guint i;
+
+    name = g_strdup (nevra);
+    arch = strrchr (name, '.');
+    if (arch)
+        *arch++ = '\0';
+    release = strrchr (name, '-');
+    if (release)
+        *release++ = '\0';
+    version = strrchr (name, '-');
+    if (version)
+        *version++ = '\0';
+
+    if (!arch || !release || !version || !*name) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not parse %s: not a NEVRA", nevra);
+        g_free (name);
+        return 0;
+    }
+
+    epoch = "0";
+    sep = strchr (version, ':');
+    if (sep) {
+        *sep = '\0';
+        epoch = version;
+        version = sep + 1;
+    }
+
+    for (i = 0; i < depsolve->n_caches; i++) {
+        sqlite3_stmt *handle = depsolve->caches[i].nevra;
+        int rc;
+
+        sqlite3_bind_text (handle, 1, name, -1, SQLITE_STATIC);
+        sqlite3_bind_text (handle, 2, version, -1, SQLITE_STATIC);
+        sqlite3_bind_text (handle, 3, release, -1, SQLITE_STATIC);
+        sqlite3_bind_text (handle, 4, arch, -1, SQLITE_STATIC);
+        sqlite3_bind_text (handle, 5, epoch, -1, SQLITE_STATIC);
+
+        while ((rc = sqlite3_step (handle)) == SQLITE_ROW) {
+            yum_depsolve_add (depsolve, i, sqlite3_column_int64 (handle, 0));
+            added++;
+        }
+        sqlite3_reset (handle);
+
+        if (rc != SQLITE_DONE) {
+            g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                         "Can not find %s: %s", nevra,
+                         sqlite3_errmsg (depsolve->caches[i].db));
+            break;
+        }
+    }
+
+    g_free (name);
+
+    return added;
+}
+
+static char *
+chunk_column (GStringChunk *chunk, sqlite3_stmt *handle, int column)
+{
+    const char *text = (const char *) sqlite3_column_text (handle, column);
+
+    return text ? g_string_chunk_insert_const (chunk, text) : NULL;
+}
+
+/* Appends the providers of name in cache to found */
+static void
+find_providers (YumDepsolve *depsolve,
+                guint cache,
+                const char *name,
+                GArray *found,
+                GError **err)
+{
+    DepsolveCache *c = &depsolve->caches[cache];
+    sqlite3_stmt *handle;
+    Provider provider;
+    int rc;
+
+    memset (&provider, 0, sizeof (provider));
+    provider.package.cache = cache;
+
+    handle = c->provides;
+    sqlite3_bind_text (handle, 1, name, -1, SQLITE_STATIC);
+    while ((rc = sqlite3_step (handle)) == SQLITE_ROW) {
+        provider.package.pkgKey = sqlite3_column_int64 (handle, 0);
+        provider.provide.flags = chunk_column (depsolve->chunk, handle, 1);
+        provider.provide.epoch = chunk_column (depsolve->chunk, handle, 2);
+        provider.provide.version = chunk_column (depsolve->chunk, handle, 3);
+        provider.provide.release = chunk_column (depsolve->chunk, handle, 4);
+        g_array_append_val (found, provider);
+    }
+    sqlite3_reset (handle);
+
+    /* A file provides any version of itself */
+    if (rc == SQLITE_DONE && name[0] == '/') {
+        memset (&provider.provide, 0, sizeof (provider.provide));
+
+        handle = c->files;
+        sqlite3_bind_text (handle, 1, name, -1, SQLITE_STATIC);
+        while ((rc = sqlite3_step (handle)) == SQLITE_ROW) {
+            provider.package.pkgKey = sqlite3_column_int64 (handle, 0);
+            g_array_append_val (found, provider);
+        }
+        sqlite3_reset (handle);
+    }
+
+    if (rc != SQLITE_DONE)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not find providers of %s: %s", name,
+                     sqlite3_errmsg (c->db));
+}
+
+static GArray *
+lookup_providers (YumDepsolve *depsolve, const char *name, GError **err)
+{
+    GArray *found;
+    guint i;
+
+    found = g_hash_table_lookup (depsolve->providers, name);
+    if (found)
+        return found;
+
+    found = g_array_new (FALSE, FALSE, sizeof (Provider));
+    for (i = 0; i < depsolve->n_caches && !*err; i++)
+        find_providers (depsolve, i, name, found, err);
+
+    if (*err) {
+        g_array_free (found, TRUE);
+        return NULL;
+    }
+
+    g_hash_table_insert (depsolve->providers,
+                         g_string_chunk_insert_const (depsolve->chunk, name),
+                         found);
+
+    return found;
+}
+
+static int
+package_cmp (gconstpointer a, gconstpointer b)
+{
+    const YumDepsolvePackage *pa = a;
+    const YumDepsolvePackage *pb = b;
+
+    if (pa->cache != pb->cache)
+        return pa->cache < pb->cache ? -1 : 1;
+    if (pa->pkgKey != pb->pkgKey)
+        return pa->pkgKey < pb->pkgKey ? -1 : 1;
+
+    return 0;
+}
+
+/*  The providers of require whose versions match, each package once and
+ * in (cache, pkgKey) order. */
+static void
+match_providers (GArray *providers, const Dependency *require, GArray *matched)
+{
+    YumDepsolvePackage *packages;
+    guint i;
+    guint n;
+
+    g_array_set_size (matched, 0);
+    for (i = 0; i < providers->len; i++) {
+        Provider *provider = &g_array_index (providers, Provider, i);
+
+        if (yum_evr_dep_overlap (&provider->provide, require))
+            g_array_append_val (matched, provider->package);
+    }
+
+    if (matched->len < 2)
+        return;
+
+    g_array_sort (matched, package_cmp);
+    packages = (YumDepsolvePackage *) matched->data;
+    for (i = 1, n = 1; i < matched->len; i++) {
+        if (package_cmp (&packages[i], &packages[n - 1]))
+            packages[n++] = packages[i];
+    }
+    g_array_set_size (matched, n);
+}
+
+/*  Resolves the requires of the packages added against the provides and
+ * primary files of all the caches, calling fn for each. rpmlib() requires
+ * are left to rpm. Files only in filelists are not looked at, like for
+ * yum's own first pass. */
+void
+yum_depsolve_run (YumDepsolve *depsolve,
+                  YumDepsolveFn fn,
+                  gpointer user_data,
+                  GError **err)
+{
+    GArray *matched;
+    Dependency require;
+    guint i;
+
+    matched = g_array_new (FALSE, FALSE, sizeof (YumDepsolvePackage));
+    memset (&require, 0, sizeof (require));
+
+    for (i = 0; i < depsolve->packages->len && !*err; i++) {
+        YumDepsolvePackage *package;
+        DepsolveCache *cache;
+        sqlite3_stmt *handle;
+        GArray *providers;
+        int rc;
+
+        package = &g_array_index (depsolve->packages, YumDepsolvePackage, i);
+        cache = &depsolve->caches[package->cache];
+        handle = cache->requires;
+
+        sqlite3_bind_int64 (handle, 1, package->pkgKey);
+        while ((rc = sqlite3_step (handle)) == SQLITE_ROW) {
+            require.name = (char *) sqlite3_column_text (handle, 0);
+            require.flags = (char *) sqlite3_column_text (handle, 1);
+            require.epoch = (char *) sqlite3_column_text (handle, 2);
+            require.version = (char *) sqlite3_column_text (handle, 3);
+            require.release = (char *) sqlite3_column_text (handle, 4);
+
+            if (!require.name || g_str_has_prefix (require.name, "rpmlib("))
+                continue;
+
+            providers = lookup_providers (depsolve, require.name, err);
+            if (*err)
+                break;
+
+            match_providers (providers, &require, matched);
+            fn (package, &require, (YumDepsolvePackage *) matched->data,
+                matched->len, user_data);
+        }
+
+        if (!*err && rc != SQLITE_DONE)
+            g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                         "Can not read requires: %s",
+                         sqlite3_errmsg (cache->db));
+        sqlite3_reset (handle);
+    }
+
+    g_array_free (matched, TRUE);
+}
+
+void
+yum_depsolve_free (YumDepsolve *depsolve)
+{
+    guint i;
+
+    for (i = 0; i < depsolve->n_caches; i++)
+        depsolve_cache_close (&depsolve->caches[i]);
+
+    g_free (depsolve->caches);
+    g_array_free (depsolve->packages, TRUE);
+    g_hash_table_destroy (depsolve->providers);
+    g_string_chunk_free (depsolve->chunk);
+    g_free (depsolve);
+}
@@ -0,0 +1,56 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __YUM_DEPSOLVE_H__
+#define __YUM_DEPSOLVE_H__
+
+#include <glib.h>
+#include "package.h"
+
+/* A package of one of the primary caches of a YumDepsolve */
+typedef struct {
+    guint cache;
+    gint64 pkgKey;
+} YumDepsolvePackage;
+
+/*  Called for every require of every package added, with the packages
+ * of all the caches providing it. n_providers is 0 for the unresolved
+ * ones. */
+typedef void (*YumDepsolveFn) (const YumDepsolvePackage *package,
+                               const Dependency *require,
+                               const YumDepsolvePackage *providers,
+                               guint n_providers,
+                               gpointer user_data);
+
+typedef struct _YumDepsolve YumDepsolve;
+
+YumDepsolve *yum_depsolve_new       (const char **primaries,
+                                     guint n_primaries,
+                                     GError **err);
+void         yum_depsolve_add       (YumDepsolve *depsolve,
+                                     guint cache,
+                                     gint64 pkgKey);
+guint        yum_depsolve_add_nevra (YumDepsolve *depsolve,
+                                     const char *nevra,
+                                     GError **err);
+void         yum_depsolve_run       (YumDepsolve *depsolve,
+                                     YumDepsolveFn fn,
+                                     gpointer user_data,
+                                     GError **err);
+void         yum_depsolve_free      (YumDepsolve *depsolve);
+
+#endif /* __YUM_DEPSOLVE_H__ */
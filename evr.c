@@ -0,0 +1,274 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <string.h>
+#include "evr.h"
+
+#define DEP_LESS    (1 << 0)
+#define DEP_GREATER (1 << 1)
+#define DEP_EQUAL   (1 << 2)
+
+/*  The tokens of a sort key, ordered the way yum_rpmvercmp () orders what
+ * they stand for. */
+#define KEY_TILDE   0x01
+#define KEY_END     0x02
+#define KEY_CARET   0x03
+#define KEY_ALPHA   0x04    /* The letters, then a 0 */
+#define KEY_NUMBER  0x05    /* Digit count, then the digits */
+
+/* Digit counts from this on take 4 more bytes */
+#define KEY_LONG_NUMBER 0xff
+
+/*  rpm's version comparison: the strings are split into runs of digits
+ * and runs of letters, everything else only separates them. Digit runs
+ * compare as numbers and beat letter runs, '~' sorts before anything,
+ * even the end of the string, and '^' after the end but before anything
+ * else. */
+int
+yum_rpmvercmp (const char *a, const char *b)
+{
+    const char *one = a;
+    const char *two = b;
+    const char *end1;
+    const char *end2;
+    gboolean isnum;
+    gsize len1;
+    gsize len2;
+    int rc;
+
+    if (!strcmp (a, b))
+        return 0;
+
+    while (*one || *two) {
+        while (*one && !g_ascii_isalnum (*one) && *one != '~' && *one != '^')
+            one++;
+        while (*two && !g_ascii_isalnum (*two) && *two != '~' && *two != '^')
+            two++;
+
+        if (*one == '~' || *two == '~') {
+            if (*one != '~')
+                return 1;
+            if (*two != '~')
+                return -1;
+            one++;
+            two++;
+            continue;
+        }
+
+        if (*one == '^' || *two == '^') {
+            if (!*one)
+                return -1;
+            if (!*two)
+                return 1;
+            if (*one != '^')
+                return 1;
+            if (*two != '^')
+                return -1;
+            one++;
+            two++;
+            continue;
+        }
+
+        if (!(*one && *two))
+            break;
+
+        end1 = one;
+        end2 = two;
+        isnum = g_ascii_isdigit (*one);
+        if (isnum) {
+            while (g_ascii_isdigit (*end1))
+                end1++;
+            while (g_ascii_isdigit (*end2))
+                end2++;
+        } else {
+            while (g_ascii_isalpha (*end1))
+                end1++;
+            while (g_ascii_isalpha (*end2))
+                end2++;
+        }
+
+        /* The runs are of different kinds, numbers are newer */
+        if (two == end2)
+            return isnum ? 1 : -1;
+
+        if (isnum) {
+            while (*one == '0' && one < end1 - 1)
+                one++;
+            while (*two == '0' && two < end2 - 1)
+                two++;
+            if (end1 - one != end2 - two)
+                return end1 - one > end2 - two ? 1 : -1;
+        }
+
+        len1 = end1 - one;
+        len2 = end2 - two;
+        rc = memcmp (one, two, MIN (len1, len2));
+        if (rc)
+            return rc < 0 ? -1 : 1;
+        if (len1 != len2)
+            return len1 < len2 ? -1 : 1;
+
+        one = end1;
+        two = end2;
+    }
+
+    if (!*one && !*two)
+        return 0;
+
+    return *one ? 1 : -1;
+}
+
+/*  Appends the sort key of version to key: memcmp () orders two keys the
+ * way yum_rpmvercmp () orders their versions, and equal keys are what it
+ * calls equal. Separators are dropped, letters are kept up to a 0 and
+ * numbers lose their leading zeros and are preceded by their length, so
+ * a longer number sorts later. */
+static void
+version_sort_key (const char *version, GString *key)
+{
+    const char *p = version;
+    const char *end;
+    gsize len;
+
+    while (*p) {
+        if (*p == '~' || *p == '^') {
+            g_string_append_c (key, *p == '~' ? KEY_TILDE : KEY_CARET);
+            p++;
+        } else if (g_ascii_isdigit (*p)) {
+            while (*p == '0')
+                p++;
+            for (end = p; g_ascii_isdigit (*end); end++)
+                ;
+            len = end - p;
+
+            g_string_append_c (key, KEY_NUMBER);
+            if (len < KEY_LONG_NUMBER)
+                g_string_append_c (key, (char) len);
+            else {
+                g_string_append_c (key, (char) KEY_LONG_NUMBER);
+                g_string_append_c (key, (char) (len >> 24));
+                g_string_append_c (key, (char) (len >> 16));
+                g_string_append_c (key, (char) (len >> 8));
+                g_string_append_c (key, (char) len);
+            }
+            g_string_append_len (key, p, len);
+            p = end;
+        } else if (g_ascii_isalpha (*p)) {
+            for (end = p; g_ascii_isalpha (*end); end++)
+                ;
+            g_string_append_c (key, KEY_ALPHA);
+            g_string_append_len (key, p, end - p);
+            g_string_append_c (key, '\0');
+            p = end;
+        } else
+            p++;
+    }
+
+    g_string_append_c (key, KEY_END);
+}
+
+static const char *
+epoch_or_zero (const char *epoch)
+{
+    return epoch && *epoch ? epoch : "0";
+}
+
+/*  Orders two [epoch:]version-release labels, a missing epoch is 0 and a
+ * missing release matches any. */
+int
+yum_evr_cmp (const char *epoch1,
+             const char *version1,
+             const char *release1,
+             const char *epoch2,
+             const char *version2,
+             const char *release2)
+{
+    int rc;
+
+    rc = yum_rpmvercmp (epoch_or_zero (epoch1), epoch_or_zero (epoch2));
+    if (rc)
+        return rc;
+
+    rc = yum_rpmvercmp (version1 ? version1 : "", version2 ? version2 : "");
+    if (rc)
+        return rc;
+
+    if (release1 && *release1 && release2 && *release2)
+        return yum_rpmvercmp (release1, release2);
+
+    return 0;
+}
+
+static int
+dep_sense (const char *flags)
+{
+    if (!flags || !*flags)
+        return 0;
+    if (!strcmp (flags, "EQ"))
+        return DEP_EQUAL;
+    if (!strcmp (flags, "LT"))
+        return DEP_LESS;
+    if (!strcmp (flags, "LE"))
+        return DEP_LESS | DEP_EQUAL;
+    if (!strcmp (flags, "GT"))
+        return DEP_GREATER;
+    if (!strcmp (flags, "GE"))
+        return DEP_GREATER | DEP_EQUAL;
+
+    return 0;
+}
+
+/*  Whether the version ranges of two dependencies of the same name, a
+ * provide and a require say, have a version in common. One without flags
+ * or version stands for all of them. */
+gboolean
+yum_evr_dep_overlap (const Dependency *a, const Dependency *b)
+{
+    int a_sense = dep_sense (a->flags);
+    int b_sense = dep_sense (b->flags);
+    int rc;
+
+    if (!a_sense || !b_sense || !a->version || !b->version)
+        return TRUE;
+
+    rc = yum_evr_cmp (a->epoch, a->version, a->release,
+                      b->epoch, b->version, b->release);
+
+    if (rc < 0)
+        return (a_sense & DEP_GREATER) || (b_sense & DEP_LESS);
+    if (rc > 0)
+        return (a_sense & DEP_LESS) || (b_sense & DEP_GREATER);
+
+    return ((a_sense & DEP_EQUAL) && (b_sense & DEP_EQUAL)) ||
+        ((a_sense & DEP_LESS) && (b_sense & DEP_LESS)) ||
+        ((a_sense & DEP_GREATER) && (b_sense & DEP_GREATER));
+}
+
+/*  A binary key of epoch:version-release that memcmp () orders like
+ * yum_evr_cmp (), except that a missing release sorts first instead of
+ * matching any. Replaces what was in key. */
+void
+yum_evr_sort_key (const char *epoch,
+                  const char *version,
+                  const char *release,
+                  GString *key)
+{
+    g_string_truncate (key, 0);
+    version_sort_key (epoch_or_zero (epoch), key);
+    version_sort_key (version ? version : "", key);
+    version_sort_key (release ? release : "", key);
+}
@@ -0,0 +1,38 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __YUM_EVR_H__
+#define __YUM_EVR_H__
+
+#include <glib.h>
+#include "package.h"
+
+/* Comparisons of rpm versions, matching rpmvercmp () and rpmdsCompare () */
+int      yum_rpmvercmp       (const char *a, const char *b);
+int      yum_evr_cmp         (const char *epoch1,
+                              const char *version1,
+                              const char *release1,
+                              const char *epoch2,
+                              const char *version2,
+                              const char *release2);
+gboolean yum_evr_dep_overlap (const Dependency *a, const Dependency *b);
+void     yum_evr_sort_key    (const char *epoch,
+                              const char *version,
+                              const char *release,
+                              GString *key);
+
+#endif /* __YUM_EVR_H__ */
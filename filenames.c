@@ -0,0 +1,284 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <string.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "filenames.h"
+
+/*  Front coded blobs shorter than this are left alone, a zstd frame
+ * header costs more than compressing a few names gains. */
+#define YMP_CONFIG_COMPRESS_MIN 256
+#define YMP_CONFIG_COMPRESS_LEVEL 3
+
+/* Blobs claiming to hold more than this are taken to be corrupt */
+#define YUM_FILENAMES_MAX_RAW (256 * 1024 * 1024)
+
+static void
+varint_append (GString *out, guint64 n)
+{
+    while (n >= 0x80) {
+        g_string_append_c (out, (char) (n & 0x7f) | 0x80);
+        n >>= 7;
+    }
+    g_string_append_c (out, (char) n);
+}
+
+/* Reads a varint at *pos, FALSE when it runs past end */
+static gboolean
+varint_read (const guchar **pos, const guchar *end, guint64 *n)
+{
+    const guchar *p = *pos;
+    int shift = 0;
+
+    *n = 0;
+    while (p < end && shift < 64) {
+        *n |= (guint64) (*p & 0x7f) << shift;
+        if (!(*p++ & 0x80)) {
+            *pos = p;
+            return TRUE;
+        }
+        shift += 7;
+    }
+
+    return FALSE;
+}
+
+/* Starts iter at names, which NULL leaves without any */
+void
+yum_filenames_iter_init (YumFilenamesIter *iter, const char *names, gsize len)
+{
+    iter->next = names;
+    iter->end = names + len;
+}
+
+/* Sets name and name_len to the next name, FALSE after the last one */
+gboolean
+yum_filenames_iter_next (YumFilenamesIter *iter,
+                         const char **name,
+                         gsize *name_len)
+{
+    const char *sep;
+
+    if (!iter->next)
+        return FALSE;
+
+    sep = memchr (iter->next, '/', iter->end - iter->next);
+    if (!sep)
+        sep = iter->end;
+    *name = iter->next;
+    *name_len = sep - iter->next;
+    iter->next = sep < iter->end ? sep + 1 : NULL;
+
+    return TRUE;
+}
+
+/* Whether the '/' separated names have one that is name */
+gboolean
+yum_filenames_contain (const char *names,
+                       gsize len,
+                       const char *name,
+                       gsize name_len)
+{
+    YumFilenamesIter iter;
+    const char *next;
+    gsize next_len;
+
+    yum_filenames_iter_init (&iter, names, len);
+    while (yum_filenames_iter_next (&iter, &next, &next_len)) {
+        if (next_len == name_len && !memcmp (next, name, name_len))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*  The name path has in the filenames of a row of dirname, which is
+ * joined to its names by a slash unless it ends in one. NULL if path is
+ * not directly in dirname. */
+const char *
+yum_filenames_path_name (const char *dirname, const char *path)
+{
+    gsize dir_len = strlen (dirname);
+
+    if (strncmp (path, dirname, dir_len))
+        return NULL;
+    path += dir_len;
+    if (!dir_len || dirname[dir_len - 1] != '/') {
+        if (*path != '/')
+            return NULL;
+        path++;
+    }
+
+    return strchr (path, '/') ? NULL : path;
+}
+
+gboolean
+yum_filenames_can_compress (void)
+{
+#ifdef HAVE_ZSTD
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+#ifdef HAVE_ZSTD
+/* Replaces the front coded blob in out by its zstd frame if that is smaller */
+static void
+compress_blob (GString *out)
+{
+    GString *frame;
+    size_t bound;
+    size_t size;
+
+    if (out->len < YMP_CONFIG_COMPRESS_MIN)
+        return;
+
+    bound = ZSTD_compressBound (out->len);
+    frame = g_string_sized_new (bound + 11);
+    g_string_append_c (frame, YUM_FILENAMES_COMPRESSED);
+    varint_append (frame, out->len);
+
+    size = ZSTD_compress (frame->str + frame->len, bound,
+                          out->str, out->len, YMP_CONFIG_COMPRESS_LEVEL);
+    if (!ZSTD_isError (size) && frame->len + size < out->len) {
+        g_string_truncate (out, 0);
+        g_string_append_len (out, frame->str, frame->len);
+        g_string_append_len (out, frame->str + frame->len, size);
+    }
+
+    g_string_free (frame, TRUE);
+}
+#endif
+
+/*  Front codes the '/' separated names into out, each name as the length
+ * it shares with the one before and the rest. rpm lists the files of a
+ * package sorted, so consecutive names in a directory share most of their
+ * prefixes. The names are kept in their order, decoding gives back the
+ * very same string and the filetypes stay lined up with it. */
+void
+yum_filenames_encode (const char *names,
+                      gsize len,
+                      gboolean compress,
+                      GString *out)
+{
+    YumFilenamesIter iter;
+    const char *prev = NULL;
+    gsize prev_len = 0;
+    const char *name;
+    gsize name_len;
+    gsize shared;
+
+    g_string_truncate (out, 0);
+    g_string_append_c (out, YUM_FILENAMES_FRONT_CODED);
+
+    yum_filenames_iter_init (&iter, names, len);
+    while (yum_filenames_iter_next (&iter, &name, &name_len)) {
+        shared = 0;
+        while (shared < prev_len && shared < name_len &&
+               prev[shared] == name[shared])
+            shared++;
+
+        varint_append (out, shared);
+        varint_append (out, name_len - shared);
+        g_string_append_len (out, name + shared, name_len - shared);
+
+        prev = name;
+        prev_len = name_len;
+    }
+
+#ifdef HAVE_ZSTD
+    if (compress)
+        compress_blob (out);
+#endif
+}
+
+static gboolean
+decode_front_coded (const guchar *pos, const guchar *end, GString *out)
+{
+    gboolean first = TRUE;
+    gsize prev = out->len;
+    guint64 shared;
+    guint64 suffix;
+    gsize name;
+
+    while (pos < end) {
+        if (!varint_read (&pos, end, &shared) ||
+            !varint_read (&pos, end, &suffix))
+            return FALSE;
+        if (suffix > (guint64) (end - pos) || shared > out->len - prev)
+            return FALSE;
+
+        if (!first)
+            g_string_append_c (out, '/');
+        first = FALSE;
+        name = out->len;
+
+        /* out may move while it grows, copy the prefix from an offset */
+        g_string_set_size (out, name + shared);
+        memmove (out->str + name, out->str + prev, shared);
+        g_string_append_len (out, (const char *) pos, suffix);
+
+        pos += suffix;
+        prev = name;
+    }
+
+    return TRUE;
+}
+
+/*  Decodes a blob of yum_filenames_encode () into the '/' separated names
+ * in out. FALSE if the blob is corrupt, or compressed and zstd support
+ * was not built in. */
+gboolean
+yum_filenames_decode (const guchar *blob, gsize len, GString *out)
+{
+    g_string_truncate (out, 0);
+
+    if (len == 0)
+        return FALSE;
+
+    if (blob[0] == YUM_FILENAMES_FRONT_CODED)
+        return decode_front_coded (blob + 1, blob + len, out);
+
+#ifdef HAVE_ZSTD
+    if (blob[0] == YUM_FILENAMES_COMPRESSED) {
+        const guchar *pos = blob + 1;
+        const guchar *end = blob + len;
+        guint64 raw_len;
+        guchar *raw;
+        size_t size;
+        gboolean ok;
+
+        if (!varint_read (&pos, end, &raw_len) ||
+            raw_len == 0 || raw_len > YUM_FILENAMES_MAX_RAW)
+            return FALSE;
+
+        raw = g_malloc (raw_len);
+        size = ZSTD_decompress (raw, raw_len, pos, end - pos);
+        ok = !ZSTD_isError (size) && size == raw_len &&
+            raw[0] == YUM_FILENAMES_FRONT_CODED &&
+            decode_front_coded (raw + 1, raw + raw_len, out);
+        g_free (raw);
+
+        return ok;
+    }
+#endif
+
+    return FALSE;
+}
@@ -0,0 +1,62 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __YUM_FILENAMES_H__
+#define __YUM_FILENAMES_H__
+
+#include <glib.h>
+
+/*  Encoded filelist filenames. A blob starts with one of these, followed
+ * for YUM_FILENAMES_FRONT_CODED by a (shared prefix length, suffix
+ * length, suffix) triple of varints and bytes per name, and for
+ * YUM_FILENAMES_COMPRESSED by the varint length of the front coded blob
+ * and that blob as one zstd frame. */
+#define YUM_FILENAMES_FRONT_CODED 'F'
+#define YUM_FILENAMES_COMPRESSED  'Z'
+
+/*  Walks the '/' separated names of a filelist row. Every '/' ends a name,
+ * as with the split ('/') yum reads the rows with, so an empty string is
+ * one empty name, the file named like its directory. */
+typedef struct {
+    const char *next;           /* Start of the next name, NULL when done */
+    const char *end;
+} YumFilenamesIter;
+
+void     yum_filenames_iter_init    (YumFilenamesIter *iter,
+                                     const char *names,
+                                     gsize len);
+gboolean yum_filenames_iter_next    (YumFilenamesIter *iter,
+                                     const char **name,
+                                     gsize *name_len);
+gboolean yum_filenames_contain      (const char *names,
+                                     gsize len,
+                                     const char *name,
+                                     gsize name_len);
+const char *yum_filenames_path_name (const char *dirname,
+                                     const char *path);
+
+gboolean yum_filenames_can_compress (void);
+
+void     yum_filenames_encode       (const char *names,
+                                     gsize len,
+                                     gboolean compress,
+                                     GString *out);
+gboolean yum_filenames_decode       (const guchar *blob,
+                                     gsize len,
+                                     GString *out);
+
+#endif /* __YUM_FILENAMES_H__ */
@@ -0,0 +1,55 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include "hash.h"
+
+/* 64 bit FNV-1a */
+guint64
+yum_hash_fnv1a (const void *data, gsize len)
+{
+    const guchar *bytes = data;
+    guint64 hash = G_GUINT64_CONSTANT (14695981039346656037);
+    gsize i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= G_GUINT64_CONSTANT (1099511628211);
+    }
+
+    return hash;
+}
+
+/*  The splitmix64 finalizer. FNV-1a leaves the low bits weak, this
+ * spreads every input bit over all 64. */
+guint64
+yum_hash_mix (guint64 hash)
+{
+    hash ^= hash >> 30;
+    hash *= G_GUINT64_CONSTANT (0xbf58476d1ce4e5b9);
+    hash ^= hash >> 27;
+    hash *= G_GUINT64_CONSTANT (0x94d049bb133111eb);
+    hash ^= hash >> 31;
+
+    return hash;
+}
+
+/* For hash tables and filters, which use the low and high bits alike */
+guint64
+yum_hash_name (const char *name, gsize len)
+{
+    return yum_hash_mix (yum_hash_fnv1a (name, len));
+}
@@ -0,0 +1,30 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __YUM_HASH_H__
+#define __YUM_HASH_H__
+
+#include <glib.h>
+
+/*  The hashes stored in the caches and the files next to them. Changing
+ * either changes what those files mean. */
+
+guint64 yum_hash_fnv1a (const void *data, gsize len);
+guint64 yum_hash_mix   (guint64 hash);
+guint64 yum_hash_name  (const char *name, gsize len);
+
+#endif /* __YUM_HASH_H__ */
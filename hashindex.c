@@ -0,0 +1,405 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "hashindex.h"
+#include "hash.h"
+#include "mapfile.h"
+
+#define HASH_INDEX_MAGIC "YMPHIDX1"
+#define HASH_INDEX_VERSION 1
+
+/* Marks an unused slot */
+#define HASH_INDEX_EMPTY G_MAXUINT32
+
+/*  The file is this header, the slots of each table, then the entries of
+ * each table, all in the byte order of the host that built the cache it
+ * sits next to. Offsets are from the start of the file.
+ *
+ * A table is an open addressing hash table with at least two slots per
+ * name. An entry is the name length, the number of pkgKeys, the name
+ * padded to 4 bytes and the pkgKeys, so a lookup costs a probe or two and
+ * the pkgKeys are handed out straight from the mapping. */
+typedef struct {
+    guint32 n_slots;
+    guint32 n_keys;
+    guint64 slots;
+    guint64 entries;
+    guint64 entries_size;
+} HashIndexTableHeader;
+
+typedef struct {
+    char magic[8];
+    guint32 version;
+    guint32 n_tables;
+    HashIndexTableHeader tables[YUM_HASH_INDEX_N_TABLES];
+} HashIndexHeader;
+
+typedef struct {
+    guint32 hash;       /* The upper half of the name's hash */
+    guint32 entry;      /* Offset in the table's entries */
+} HashIndexSlot;
+
+typedef struct {
+    guint32 name_len;
+    guint32 n_pkgs;
+} HashIndexEntry;
+
+typedef struct {
+    GString *entries;
+    GArray *slots;      /* One per name, spread out when written */
+    gsize last;         /* Offset of the last entry */
+    gint64 last_pkgKey;
+} BuilderTable;
+
+struct _YumHashIndexBuilder {
+    BuilderTable tables[YUM_HASH_INDEX_N_TABLES];
+    gboolean overflow;
+};
+
+struct _YumHashIndex {
+    const char *map;
+    gsize map_size;
+    const HashIndexHeader *header;
+};
+
+GQuark
+yum_hash_index_error_quark (void)
+{
+    static GQuark quark;
+
+    if (!quark)
+        quark = g_quark_from_static_string ("yum_hash_index_error");
+
+    return quark;
+}
+
+static gsize
+pad4 (gsize len)
+{
+    return (len + 3) & ~(gsize) 3;
+}
+
+YumHashIndexBuilder *
+yum_hash_index_builder_new (void)
+{
+    YumHashIndexBuilder *builder;
+    int i;
+
+    builder = g_new0 (YumHashIndexBuilder, 1);
+    for (i = 0; i < YUM_HASH_INDEX_N_TABLES; i++) {
+        builder->tables[i].entries = g_string_sized_new (4096);
+        builder->tables[i].slots = g_array_new (FALSE, FALSE,
+                                                sizeof (HashIndexSlot));
+    }
+
+    return builder;
+}
+
+/*  Adds pkgKey to the list of name. The rows of one name must come
+ * together, in pkgKey order, as ORDER BY name, pkgKey hands them out. */
+void
+yum_hash_index_builder_add (YumHashIndexBuilder *builder,
+                            YumHashIndexTable table,
+                            const char *name,
+                            gsize len,
+                            gint64 pkgKey)
+{
+    BuilderTable *t = &builder->tables[table];
+    HashIndexEntry *entry = NULL;
+    guint32 key;
+    gsize pos;
+
+    if (pkgKey < 0 || pkgKey > G_MAXUINT32) {
+        builder->overflow = TRUE;
+        return;
+    }
+
+    if (t->slots->len > 0) {
+        entry = (HashIndexEntry *) (t->entries->str + t->last);
+        if (entry->name_len != len ||
+            memcmp (entry + 1, name, len) != 0)
+            entry = NULL;
+    }
+
+    if (!entry) {
+        HashIndexEntry header;
+        HashIndexSlot slot;
+
+        pos = t->entries->len;
+        header.name_len = len;
+        header.n_pkgs = 0;
+        g_string_append_len (t->entries, (const char *) &header,
+                             sizeof (header));
+        g_string_append_len (t->entries, name, len);
+        g_string_set_size (t->entries, pos + sizeof (header) + pad4 (len));
+        memset (t->entries->str + pos + sizeof (header) + len, 0,
+                pad4 (len) - len);
+
+        slot.hash = yum_hash_name (name, len) >> 32;
+        slot.entry = pos;
+        g_array_append_val (t->slots, slot);
+
+        t->last = pos;
+        t->last_pkgKey = -1;
+    } else if (pkgKey == t->last_pkgKey)
+        return;
+
+    key = pkgKey;
+    g_string_append_len (t->entries, (const char *) &key, sizeof (key));
+    ((HashIndexEntry *) (t->entries->str + t->last))->n_pkgs++;
+    t->last_pkgKey = pkgKey;
+}
+
+/* Spreads the slots of t over a table of n_slots, by their full hash */
+static HashIndexSlot *
+builder_table_slots (BuilderTable *t, guint32 n_slots)
+{
+    HashIndexSlot *slots;
+    HashIndexEntry *entry;
+    guint32 mask = n_slots - 1;
+    guint32 i;
+    guint32 j;
+
+    slots = g_new (HashIndexSlot, n_slots);
+    for (i = 0; i < n_slots; i++)
+        slots[i].entry = HASH_INDEX_EMPTY;
+
+    for (i = 0; i < t->slots->len; i++) {
+        HashIndexSlot *slot = &g_array_index (t->slots, HashIndexSlot, i);
+
+        entry = (HashIndexEntry *) (t->entries->str + slot->entry);
+        j = yum_hash_name ((const char *) (entry + 1), entry->name_len) & mask;
+        while (slots[j].entry != HASH_INDEX_EMPTY)
+            j = (j + 1) & mask;
+        slots[j] = *slot;
+    }
+
+    return slots;
+}
+
+void
+yum_hash_index_builder_write (YumHashIndexBuilder *builder,
+                              const char *path,
+                              GError **err)
+{
+    HashIndexHeader header;
+    HashIndexSlot *slots[YUM_HASH_INDEX_N_TABLES];
+    guint64 offset;
+    FILE *f;
+    int i;
+
+    if (builder->overflow) {
+        g_set_error (err, YUM_HASH_INDEX_ERROR, YUM_HASH_INDEX_ERROR,
+                     "Can not write %s: pkgKey out of range", path);
+        return;
+    }
+
+    memset (&header, 0, sizeof (header));
+    memcpy (header.magic, HASH_INDEX_MAGIC, sizeof (header.magic));
+    header.version = HASH_INDEX_VERSION;
+    header.n_tables = YUM_HASH_INDEX_N_TABLES;
+
+    offset = sizeof (header);
+    for (i = 0; i < YUM_HASH_INDEX_N_TABLES; i++) {
+        BuilderTable *t = &builder->tables[i];
+        guint32 n_slots = 2;
+
+        if (t->entries->len >= HASH_INDEX_EMPTY) {
+            g_set_error (err, YUM_HASH_INDEX_ERROR, YUM_HASH_INDEX_ERROR,
+                         "Can not write %s: too many names", path);
+            return;
+        }
+
+        while (n_slots < t->slots->len * 2)
+            n_slots *= 2;
+
+        header.tables[i].n_slots = n_slots;
+        header.tables[i].n_keys = t->slots->len;
+        header.tables[i].slots = offset;
+        offset += (guint64) n_slots * sizeof (HashIndexSlot);
+    }
+
+    for (i = 0; i < YUM_HASH_INDEX_N_TABLES; i++) {
+        header.tables[i].entries = offset;
+        header.tables[i].entries_size = builder->tables[i].entries->len;
+        offset += builder->tables[i].entries->len;
+    }
+
+    f = fopen (path, "w");
+    if (!f) {
+        g_set_error (err, YUM_HASH_INDEX_ERROR, YUM_HASH_INDEX_ERROR,
+                     "Can not create %s: %s", path, strerror (errno));
+        return;
+    }
+
+    for (i = 0; i < YUM_HASH_INDEX_N_TABLES; i++)
+        slots[i] = builder_table_slots (&builder->tables[i],
+                                        header.tables[i].n_slots);
+
+    if (fwrite (&header, sizeof (header), 1, f) != 1)
+        goto write_error;
+
+    for (i = 0; i < YUM_HASH_INDEX_N_TABLES; i++)
+        if (fwrite (slots[i], sizeof (HashIndexSlot),
+                    header.tables[i].n_slots, f) != header.tables[i].n_slots)
+            goto write_error;
+
+    for (i = 0; i < YUM_HASH_INDEX_N_TABLES; i++) {
+        GString *entries = builder->tables[i].entries;
+
+        if (entries->len && fwrite (entries->str, entries->len, 1, f) != 1)
+            goto write_error;
+    }
+
+    for (i = 0; i < YUM_HASH_INDEX_N_TABLES; i++)
+        g_free (slots[i]);
+
+    if (fclose (f) != 0)
+        g_set_error (err, YUM_HASH_INDEX_ERROR, YUM_HASH_INDEX_ERROR,
+                     "Can not write %s: %s", path, strerror (errno));
+    return;
+
+ write_error:
+    g_set_error (err, YUM_HASH_INDEX_ERROR, YUM_HASH_INDEX_ERROR,
+                 "Can not write %s: %s", path, strerror (errno));
+    for (i = 0; i < YUM_HASH_INDEX_N_TABLES; i++)
+        g_free (slots[i]);
+    fclose (f);
+}
+
+void
+yum_hash_index_builder_free (YumHashIndexBuilder *builder)
+{
+    int i;
+
+    for (i = 0; i < YUM_HASH_INDEX_N_TABLES; i++) {
+        g_string_free (builder->tables[i].entries, TRUE);
+        g_array_free (builder->tables[i].slots, TRUE);
+    }
+
+    g_free (builder);
+}
+
+/*  Maps the index yum_hash_index_builder_write () left in path. Only the
+ * layout is checked here, lookups check every entry they touch against
+ * the bounds of its table, so a damaged file can not take a reader past
+ * the end of the mapping. */
+YumHashIndex *
+yum_hash_index_open (const char *path, GError **err)
+{
+    YumHashIndex *index;
+    const HashIndexHeader *header;
+    const char *map;
+    gsize size;
+    gboolean valid;
+    int i;
+
+    map = yum_map_file (path, HASH_INDEX_MAGIC, HASH_INDEX_VERSION,
+                        sizeof (HashIndexHeader), "index",
+                        YUM_HASH_INDEX_ERROR, &size, err);
+    if (!map)
+        return NULL;
+
+    header = (const HashIndexHeader *) map;
+    valid = header->n_tables == YUM_HASH_INDEX_N_TABLES;
+
+    for (i = 0; valid && i < YUM_HASH_INDEX_N_TABLES; i++) {
+        const HashIndexTableHeader *t = &header->tables[i];
+
+        valid = t->n_slots && !(t->n_slots & (t->n_slots - 1))
+            && t->n_keys < t->n_slots
+            && t->slots % 4 == 0 && t->entries % 4 == 0
+            && t->slots <= size
+            && t->n_slots * sizeof (HashIndexSlot) <= size - t->slots
+            && t->entries <= size
+            && t->entries_size <= size - t->entries;
+    }
+
+    if (!valid) {
+        g_set_error (err, YUM_HASH_INDEX_ERROR, YUM_HASH_INDEX_ERROR,
+                     "Can not read %s: not a valid index", path);
+        yum_unmap_file (map, size);
+        return NULL;
+    }
+
+    index = g_new0 (YumHashIndex, 1);
+    index->map = map;
+    index->map_size = size;
+    index->header = header;
+
+    return index;
+}
+
+/*  The pkgKeys of name in table, n_pkgs of them, pointing into the
+ * mapping. NULL when the name is not in the table. */
+const guint32 *
+yum_hash_index_lookup (YumHashIndex *index,
+                       YumHashIndexTable table,
+                       const char *name,
+                       gsize len,
+                       guint32 *n_pkgs)
+{
+    const HashIndexTableHeader *t = &index->header->tables[table];
+    const HashIndexSlot *slots;
+    const char *entries;
+    guint64 h;
+    guint32 mask = t->n_slots - 1;
+    guint32 probes;
+    guint32 i;
+
+    slots = (const HashIndexSlot *) (index->map + t->slots);
+    entries = index->map + t->entries;
+    h = yum_hash_name (name, len);
+
+    for (i = h & mask, probes = 0;
+         probes < t->n_slots && slots[i].entry != HASH_INDEX_EMPTY;
+         i = (i + 1) & mask, probes++) {
+        const HashIndexEntry *entry;
+        guint64 end;
+
+        if (slots[i].hash != (guint32) (h >> 32))
+            continue;
+
+        if (slots[i].entry % 4 ||
+            slots[i].entry + sizeof (HashIndexEntry) > t->entries_size)
+            return NULL;
+
+        entry = (const HashIndexEntry *) (entries + slots[i].entry);
+        end = slots[i].entry + sizeof (HashIndexEntry) +
+            pad4 (entry->name_len) + (guint64) entry->n_pkgs * 4;
+        if (end > t->entries_size)
+            return NULL;
+
+        if (entry->name_len == len && !memcmp (entry + 1, name, len)) {
+            *n_pkgs = entry->n_pkgs;
+            return (const guint32 *) ((const char *) (entry + 1) +
+                                      pad4 (entry->name_len));
+        }
+    }
+
+    return NULL;
+}
+
+void
+yum_hash_index_free (YumHashIndex *index)
+{
+    yum_unmap_file (index->map, index->map_size);
+    g_free (index);
+}
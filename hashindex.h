@@ -0,0 +1,57 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __YUM_HASH_INDEX_H__
+#define __YUM_HASH_INDEX_H__
+
+#include <glib.h>
+
+#define YUM_HASH_INDEX_ERROR yum_hash_index_error_quark()
+GQuark yum_hash_index_error_quark (void);
+
+/* The tables of an index, each mapping names to pkgKeys */
+typedef enum {
+    YUM_HASH_INDEX_PROVIDES,
+    YUM_HASH_INDEX_PACKAGES,
+    YUM_HASH_INDEX_N_TABLES
+} YumHashIndexTable;
+
+/*  A read-only hash table file, meant to be mapped and shared by every
+ * process reading the cache it belongs to. */
+typedef struct _YumHashIndex YumHashIndex;
+typedef struct _YumHashIndexBuilder YumHashIndexBuilder;
+
+YumHashIndexBuilder *yum_hash_index_builder_new   (void);
+void                 yum_hash_index_builder_add   (YumHashIndexBuilder *builder,
+                                                   YumHashIndexTable table,
+                                                   const char *name,
+                                                   gsize len,
+                                                   gint64 pkgKey);
+void                 yum_hash_index_builder_write (YumHashIndexBuilder *builder,
+                                                   const char *path,
+                                                   GError **err);
+void                 yum_hash_index_builder_free  (YumHashIndexBuilder *builder);
+
+YumHashIndex  *yum_hash_index_open   (const char *path, GError **err);
+const guint32 *yum_hash_index_lookup (YumHashIndex *index,
+                                      YumHashIndexTable table,
+                                      const char *name,
+                                      gsize len,
+                                      guint32 *n_pkgs);
+void           yum_hash_index_free   (YumHashIndex *index);
+
+#endif /* __YUM_HASH_INDEX_H__ */
@@ -0,0 +1,85 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mapfile.h"
+
+/*  Maps the file at path read-only and shared, the mapping *size bytes
+ * long. The file must hold a header of header_size bytes starting with
+ * magic and version, the rest of it is left to the caller to check.
+ * Errors are set in domain, calling the file a what. */
+const char *
+yum_map_file (const char *path,
+              const char *magic,
+              guint32 version,
+              gsize header_size,
+              const char *what,
+              GQuark domain,
+              gsize *size,
+              GError **err)
+{
+    const YumMapHeader *header;
+    struct stat buf;
+    void *map;
+    int fd;
+
+    fd = open (path, O_RDONLY);
+    if (fd < 0) {
+        g_set_error (err, domain, domain,
+                     "Can not open %s: %s", path, strerror (errno));
+        return NULL;
+    }
+
+    if (fstat (fd, &buf) < 0 || buf.st_size < (off_t) header_size) {
+        g_set_error (err, domain, domain,
+                     "Can not read %s: truncated", path);
+        close (fd);
+        return NULL;
+    }
+
+    map = mmap (NULL, buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED) {
+        g_set_error (err, domain, domain,
+                     "Can not map %s: %s", path, strerror (errno));
+        return NULL;
+    }
+
+    header = (const YumMapHeader *) map;
+    if (memcmp (header->magic, magic, sizeof (header->magic)) ||
+        header->version != version) {
+        g_set_error (err, domain, domain,
+                     "Can not read %s: not a valid %s", path, what);
+        munmap (map, buf.st_size);
+        return NULL;
+    }
+
+    *size = buf.st_size;
+
+    return map;
+}
+
+void
+yum_unmap_file (const char *map, gsize size)
+{
+    munmap ((void *) map, size);
+}
@@ -0,0 +1,40 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __YUM_MAP_FILE_H__
+#define __YUM_MAP_FILE_H__
+
+#include <glib.h>
+
+/*  The files written next to a cache start with an 8 byte magic and a
+ * 32 bit version, the first members of their header. */
+typedef struct {
+    char magic[8];
+    guint32 version;
+} YumMapHeader;
+
+const char *yum_map_file   (const char *path,
+                            const char *magic,
+                            guint32 version,
+                            gsize header_size,
+                            const char *what,
+                            GQuark domain,
+                            gsize *size,
+                            GError **err);
+void        yum_unmap_file (const char *map, gsize size);
+
+#endif /* __YUM_MAP_FILE_H__ */
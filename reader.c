@@ -0,0 +1,242 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <string.h>
+#include "db.h"
+#include "evr.h"
+#include "reader.h"
+
+/*  How much of a cache readers map instead of reading through the page
+ * cache, more than any primary is. */
+#define YMP_CONFIG_READER_MMAP_SIZE (512 * 1024 * 1024)
+
+struct _YumReader {
+    sqlite3 *db;
+    GHashTable *statements;     /* SQL to its prepared statement */
+};
+
+static void
+statement_free (gpointer data)
+{
+    sqlite3_finalize ((sqlite3_stmt *) data);
+}
+
+YumReader *
+yum_reader_open (const char *path, GError **err)
+{
+    YumReader *reader;
+    sqlite3 *db = NULL;
+    char *sql;
+
+    if (sqlite3_open_v2 (path, &db, SQLITE_OPEN_READONLY, NULL) !=
+        SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not open %s: %s", path, sqlite3_errmsg (db));
+        sqlite3_close (db);
+        return NULL;
+    }
+
+    sql = g_strdup_printf ("PRAGMA mmap_size = %d",
+                           YMP_CONFIG_READER_MMAP_SIZE);
+    sqlite3_exec (db, sql, NULL, NULL, NULL);
+    g_free (sql);
+    sqlite3_exec (db, "PRAGMA query_only = 1", NULL, NULL, NULL);
+    yum_db_register_functions (db);
+
+    reader = g_new0 (YumReader, 1);
+    reader->db = db;
+    reader->statements = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                g_free, statement_free);
+
+    return reader;
+}
+
+sqlite3 *
+yum_reader_db (YumReader *reader)
+{
+    return reader->db;
+}
+
+/*  The statement for sql, prepared on first use and reset for the next
+ * one after that. Prepared with sqlite3_prepare_v2 () so the statements
+ * kept here survive schema changes such as an ATTACH. Owned by reader. */
+sqlite3_stmt *
+yum_reader_statement (YumReader *reader, const char *sql, GError **err)
+{
+    sqlite3_stmt *handle;
+
+    handle = g_hash_table_lookup (reader->statements, sql);
+    if (handle) {
+        sqlite3_reset (handle);
+        sqlite3_clear_bindings (handle);
+        return handle;
+    }
+
+    if (sqlite3_prepare_v2 (reader->db, sql, -1, &handle, NULL) !=
+        SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not prepare query: %s", sqlite3_errmsg (reader->db));
+        sqlite3_finalize (handle);
+        return NULL;
+    }
+
+    g_hash_table_insert (reader->statements, g_strdup (sql), handle);
+
+    return handle;
+}
+
+/*  Attaches the filelists or other cache at path as schema, read-only
+ * and mapped like the main one, so statements can join its tables with
+ * schema.table. */
+gboolean
+yum_reader_attach (YumReader *reader,
+                   const char *path,
+                   const char *schema,
+                   GError **err)
+{
+    char *sql;
+    int rc;
+
+    sql = sqlite3_mprintf ("ATTACH DATABASE %Q AS \"%w\"", path, schema);
+    rc = sqlite3_exec (reader->db, sql, NULL, NULL, NULL);
+    sqlite3_free (sql);
+    if (rc != SQLITE_OK) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not attach %s: %s", path,
+                     sqlite3_errmsg (reader->db));
+        return FALSE;
+    }
+
+    sql = sqlite3_mprintf ("PRAGMA \"%w\".mmap_size = %d", schema,
+                           YMP_CONFIG_READER_MMAP_SIZE);
+    sqlite3_exec (reader->db, sql, NULL, NULL, NULL);
+    sqlite3_free (sql);
+
+    return TRUE;
+}
+
+/*  The pkgKey of the package pkgId in the attached schema, -1 if it has
+ * none. */
+gint64
+yum_reader_attached_key (YumReader *reader,
+                         const char *schema,
+                         const char *pkgId,
+                         GError **err)
+{
+    sqlite3_stmt *handle;
+    gint64 pkgKey = -1;
+    char *sql;
+    int rc;
+
+    sql = sqlite3_mprintf ("SELECT pkgKey FROM \"%w\".packages"
+                           "  WHERE pkgId = ?", schema);
+    handle = yum_reader_statement (reader, sql, err);
+    sqlite3_free (sql);
+    if (!handle)
+        return -1;
+
+    sqlite3_bind_text (handle, 1, pkgId, -1, SQLITE_TRANSIENT);
+
+    rc = sqlite3_step (handle);
+    if (rc == SQLITE_ROW)
+        pkgKey = sqlite3_column_int64 (handle, 0);
+    else if (rc != SQLITE_DONE)
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not look up %s: %s", pkgId,
+                     sqlite3_errmsg (reader->db));
+    sqlite3_reset (handle);
+
+    return pkgKey;
+}
+
+/*  Calls fn with the index of each of deps and the pkgKey of every
+ * package with a matching row in table, which is one of the dependency
+ * tables. A dependency with flags matches rows whose versions overlap
+ * its own, one without matches every row of its name. All of them go
+ * through the one statement, each a probe of the table's name index. */
+void
+yum_reader_lookup_deps (YumReader *reader,
+                        const char *table,
+                        const Dependency *deps,
+                        guint n_deps,
+                        YumReaderDepFn fn,
+                        gpointer user_data,
+                        GError **err)
+{
+    sqlite3_stmt *handle;
+    Dependency row;
+    gint64 pkgKey;
+    gint64 last;
+    char *sql;
+    guint i;
+    int rc;
+
+    if (strcmp (table, "provides") && strcmp (table, "requires") &&
+        strcmp (table, "conflicts") && strcmp (table, "obsoletes")) {
+        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                     "Can not look up %s: not a dependency table", table);
+        return;
+    }
+
+    /* A package's rows of one name come together, to be reported once */
+    sql = g_strdup_printf ("SELECT pkgKey, flags, epoch, version, release"
+                           "  FROM %s WHERE name = ? ORDER BY pkgKey", table);
+    handle = yum_reader_statement (reader, sql, err);
+    g_free (sql);
+    if (!handle)
+        return;
+
+    memset (&row, 0, sizeof (row));
+    for (i = 0; i < n_deps; i++) {
+        sqlite3_bind_text (handle, 1, deps[i].name, -1, SQLITE_STATIC);
+
+        last = -1;
+        while ((rc = sqlite3_step (handle)) == SQLITE_ROW) {
+            pkgKey = sqlite3_column_int64 (handle, 0);
+            if (pkgKey == last)
+                continue;
+
+            if (deps[i].flags) {
+                row.flags = (char *) sqlite3_column_text (handle, 1);
+                row.epoch = (char *) sqlite3_column_text (handle, 2);
+                row.version = (char *) sqlite3_column_text (handle, 3);
+                row.release = (char *) sqlite3_column_text (handle, 4);
+                if (!yum_evr_dep_overlap (&row, &deps[i]))
+                    continue;
+            }
+
+            fn (i, pkgKey, user_data);
+            last = pkgKey;
+        }
+        sqlite3_reset (handle);
+
+        if (rc != SQLITE_DONE) {
+            g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                         "Can not look up %s: %s", table,
+                         sqlite3_errmsg (reader->db));
+            return;
+        }
+    }
+}
+
+void
+yum_reader_close (YumReader *reader)
+{
+    g_hash_table_destroy (reader->statements);
+    sqlite3_close (reader->db);
+    g_free (reader);
+}
@@ -0,0 +1,56 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __YUM_READER_H__
+#define __YUM_READER_H__
+
+#include <glib.h>
+#include <sqlite3.h>
+#include "package.h"
+
+/*  A read-only connection to a finished cache, with the file mapped into
+ * memory and every statement prepared once and kept. */
+typedef struct _YumReader YumReader;
+
+YumReader    *yum_reader_open      (const char *path, GError **err);
+sqlite3      *yum_reader_db        (YumReader *reader);
+sqlite3_stmt *yum_reader_statement (YumReader *reader,
+                                    const char *sql,
+                                    GError **err);
+gboolean      yum_reader_attach    (YumReader *reader,
+                                    const char *path,
+                                    const char *schema,
+                                    GError **err);
+gint64        yum_reader_attached_key (YumReader *reader,
+                                       const char *schema,
+                                       const char *pkgId,
+                                       GError **err);
+void          yum_reader_close     (YumReader *reader);
+
+typedef void (*YumReaderDepFn) (guint dep,
+                                gint64 pkgKey,
+                                gpointer user_data);
+
+void          yum_reader_lookup_deps (YumReader *reader,
+                                      const char *table,
+                                      const Dependency *deps,
+                                      guint n_deps,
+                                      YumReaderDepFn fn,
+                                      gpointer user_data,
+                                      GError **err);
+
+#endif /* __YUM_READER_H__ */
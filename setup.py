@@ -1,29 +1,80 @@
 import os
 from distutils.core import setup, Extension
+from distutils.command.build_ext import build_ext
+from distutils.dep_util import newer_group
 
-pc = os.popen("pkg-config --cflags-only-I glib-2.0 libxml-2.0 sqlite3", "r")
+pc = os.popen("pkg-config --cflags-only-I glib-2.0 gthread-2.0 libxml-2.0 sqlite3", "r")
 includes = list(map(lambda x:x[2:], pc.readline().split()))
 pc.close()
 
-pc = os.popen("pkg-config --libs-only-l glib-2.0 libxml-2.0 sqlite3", "r")
+pc = os.popen("pkg-config --libs-only-l glib-2.0 gthread-2.0 libxml-2.0 sqlite3", "r")
 libs = list(map(lambda x:x[2:], pc.readline().split()))
 pc.close()
 
-pc = os.popen("pkg-config --libs-only-L glib-2.0 libxml-2.0 sqlite3", "r")
+pc = os.popen("pkg-config --libs-only-L glib-2.0 gthread-2.0 libxml-2.0 sqlite3", "r")
 libdirs = list(map(lambda x:x[2:], pc.readline().split()))
 pc.close()
 
+macros = []
+if os.system("pkg-config --exists libzstd") == 0:
+    pc = os.popen("pkg-config --libs-only-l libzstd", "r")
+    libs.extend(map(lambda x:x[2:], pc.readline().split()))
+    pc.close()
+    macros.append(('HAVE_ZSTD', '1'))
+
 module = Extension('_sqlitecache',
                    include_dirs = includes,
                    libraries = libs,
                    library_dirs = libdirs,
+                   define_macros = macros + [('SQLITE_CORE', '1')],
                    sources = ['package.c',
                               'xml-parser.c',
+                              'filenames.c',
+                              'hash.c',
+                              'mapfile.c',
+                              'bloom.c',
+                              'hashindex.c',
+                              'evr.c',
+                              'depsolve.c',
+                              'reader.c',
+                              'ymp-sqlite.c',
                               'db.c',
                               'sqlitecache.c'])
 
+# The SQL functions of ymp-sqlite.c again, as a plain shared library SQLite
+# loads. It has no Python init function, so it is not an Extension.
+sqlite_extension = 'ymp_sqlite.so'
+sqlite_extension_sources = ['ymp-sqlite.c', 'evr.c', 'filenames.c']
+
+class build_ext_sqlite(build_ext):
+    def run(self):
+        build_ext.run(self)
+        output = self.sqlite_extension_path()
+        if not (self.force or newer_group(sqlite_extension_sources, output)):
+            return
+        # Apart from the objects of _sqlitecache, built with SQLITE_CORE
+        objects = self.compiler.compile(sqlite_extension_sources,
+                                        output_dir=os.path.join(self.build_temp,
+                                                                'ymp_sqlite'),
+                                        macros=macros,
+                                        include_dirs=includes,
+                                        debug=self.debug)
+        self.compiler.link_shared_object(objects, output,
+                                         libraries=libs,
+                                         library_dirs=libdirs,
+                                         debug=self.debug)
+
+    def sqlite_extension_path(self):
+        if self.inplace:
+            return sqlite_extension
+        return os.path.join(self.build_lib, sqlite_extension)
+
+    def get_outputs(self):
+        return build_ext.get_outputs(self) + [self.sqlite_extension_path()]
+
 setup (name = 'yum-metadata-parser',
        version = '1.1.4',
        description = 'A fast YUM meta-data parser',
 	   py_modules = ['sqlitecachec'],
-       ext_modules = [module])
+       ext_modules = [module],
+       cmdclass = {'build_ext': build_ext_sqlite})
@@ -16,9 +16,19 @@
  */
 
 #include <Python.h>
+#include <structmember.h>
+
+#include <stdio.h>
+#include <unistd.h>
 
 #include "xml-parser.h"
 #include "db.h"
+#include "bloom.h"
+#include "hashindex.h"
+#include "depsolve.h"
+#include "evr.h"
+#include "reader.h"
+#include "filenames.h"
 #include "package.h"
 
 /* Make room for 2500 package ids, 40 bytes + '\0' each */
@@ -27,6 +37,7 @@
 typedef struct _UpdateInfo UpdateInfo;
 
 typedef void (*InfoInitFn) (UpdateInfo *update_info, sqlite3 *db, GError **err);
+typedef void (*InfoFlushFn) (UpdateInfo *update_info, GError **err);
 typedef void (*InfoCleanFn) (UpdateInfo *update_info);
 
 typedef void (*XmlParseFn)  (const char *filename,
@@ -39,9 +50,15 @@ typedef void (*WriteDbPackageFn) (UpdateInfo *update_info, Package *package);
 
 typedef void (*IndexTablesFn) (sqlite3 *db, GError **err);
 
+typedef void (*CreateTriggersFn) (sqlite3 *db, GError **err);
+
+typedef void (*RemovePackagesFn) (sqlite3 *db, GError **err);
+
 struct _UpdateInfo {
     sqlite3 *db;
-    sqlite3_stmt *remove_handle;
+    sqlite3_stmt *stale_handle;
+    gboolean fresh_build;
+    const char *build_path;
     guint32 count_from_md;
     guint32 packages_seen;
     guint32 add_count;
@@ -50,14 +67,19 @@ struct _UpdateInfo {
     GHashTable *all_packages;
     GStringChunk *package_ids_chunk;
     GTimer *timer;
+    const YumDbOptions *options;
     gpointer python_callback;
     
     InfoInitFn info_init;
+    InfoFlushFn info_flush;
+    InfoFlushFn info_merge;
     InfoCleanFn info_clean;
     CreateTablesFn create_tables;
     WriteDbPackageFn write_package;
     XmlParseFn xml_parse;
     IndexTablesFn index_tables;
+    CreateTriggersFn create_triggers;
+    RemovePackagesFn remove_packages;
 
     gpointer user_data;
 };
@@ -65,27 +87,23 @@ struct _UpdateInfo {
 static void
 update_info_init (UpdateInfo *info, GError **err)
 {
-    const char *sql;
-    int rc;
-
-    sql = "DELETE FROM packages WHERE pkgKey = ?";
-    rc = sqlite3_prepare (info->db, sql, -1, &info->remove_handle, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
-                     "Can not prepare package removal: %s",
-                     sqlite3_errmsg (info->db));
-        sqlite3_finalize (info->remove_handle);
-        return;
-    }
-
     info->count_from_md = 0;
     info->packages_seen = 0;
     info->add_count = 0;
     info->del_count = 0;
-    info->all_packages = g_hash_table_new (g_str_hash, g_str_equal);
-    info->package_ids_chunk = g_string_chunk_new (PACKAGE_IDS_CHUNK);
     info->timer = g_timer_new ();
     g_timer_start (info->timer);
+
+    /* A fresh database has nothing to compare against or remove */
+    if (info->fresh_build)
+        return;
+
+    info->stale_handle = yum_db_stale_packages_prepare (info->db, err);
+    if (*err)
+        return;
+
+    info->all_packages = g_hash_table_new (g_str_hash, g_str_equal);
+    info->package_ids_chunk = g_string_chunk_new (PACKAGE_IDS_CHUNK);
     info->current_packages = yum_db_read_package_ids (info->db, err);
 }
 
@@ -95,24 +113,25 @@ remove_entry (gpointer key, gpointer value, gpointer user_data)
     UpdateInfo *info = (UpdateInfo *) user_data;
 
     if (g_hash_table_lookup (info->all_packages, key) == NULL) {
-        int rc;
-
-        sqlite3_bind_int (info->remove_handle, 1, GPOINTER_TO_INT (value));
-        rc = sqlite3_step (info->remove_handle);
-        sqlite3_reset (info->remove_handle);
-
-        if (rc != SQLITE_DONE)
-            g_warning ("Error removing package from SQL: %s",
-                       sqlite3_errmsg (info->db));
-
+        yum_db_stale_package_write (info->db, info->stale_handle,
+                                    GPOINTER_TO_INT (value));
         info->del_count++;
     }
 }
 
 static void
-update_info_remove_old_entries (UpdateInfo *info)
+update_info_remove_old_entries (UpdateInfo *info, GError **err)
 {
+    sqlite3_exec (info->db, "BEGIN", NULL, NULL, NULL);
+
     g_hash_table_foreach (info->current_packages, remove_entry, info);
+    if (info->del_count > 0)
+        info->remove_packages (info->db, err);
+
+    if (*err)
+        sqlite3_exec (info->db, "ROLLBACK", NULL, NULL, NULL);
+    else
+        sqlite3_exec (info->db, "COMMIT", NULL, NULL, NULL);
 }
 
 static void
@@ -126,8 +145,8 @@ count_cb (guint32 count, gpointer user_data)
 static void
 update_info_done (UpdateInfo *info, GError **err)
 {
-    if (info->remove_handle)
-        sqlite3_finalize (info->remove_handle);
+    if (info->stale_handle)
+        sqlite3_finalize (info->stale_handle);
     if (info->current_packages)
         g_hash_table_destroy (info->current_packages);
     if (info->all_packages)
@@ -148,41 +167,171 @@ update_info_done (UpdateInfo *info, GError **err)
 
 /* Primary */
 
+/*  A parallel build writes packages and each of
+ * yum_db_primary_package_tables from a thread of its own: those less the
+ * NULL, plus packages. */
+#define N_PRIMARY_TABLES \
+    (G_N_ELEMENTS (yum_db_primary_package_tables) - 1 + 1)
+
 typedef struct {
     UpdateInfo update_info;
     sqlite3_stmt *pkg_handle;
-    sqlite3_stmt *requires_handle;
-    sqlite3_stmt *provides_handle;
-    sqlite3_stmt *conflicts_handle;
-    sqlite3_stmt *obsoletes_handle;
-    sqlite3_stmt *files_handle;
+    YumDbBatch *requires_handle;
+    YumDbBatch *provides_handle;
+    YumDbBatch *conflicts_handle;
+    YumDbBatch *obsoletes_handle;
+    YumDbBatch *files_handle;
+    YumDbLayout *layout;
+
+    /*  Parallel builds only, packages first, then the others in
+     * yum_db_primary_package_tables order */
+    gint64 last_pkgKey;
+    YumDbBatch *batches[N_PRIMARY_TABLES];
+    sqlite3 *scratch_dbs[N_PRIMARY_TABLES];
+    char *scratch_paths[N_PRIMARY_TABLES];
+    char *scratch_tables[N_PRIMARY_TABLES];
 } PackageWriterInfo;
 
+/* The handle of info writing the rows of table, NULL for none */
+static YumDbBatch **
+package_writer_handle (PackageWriterInfo *info, const char *table)
+{
+    if (!strcmp (table, "requires"))
+        return &info->requires_handle;
+    if (!strcmp (table, "provides"))
+        return &info->provides_handle;
+    if (!strcmp (table, "conflicts"))
+        return &info->conflicts_handle;
+    if (!strcmp (table, "obsoletes"))
+        return &info->obsoletes_handle;
+    if (!strcmp (table, "files"))
+        return &info->files_handle;
+
+    return NULL;
+}
+
+/*  Every primary table gets a scratch database and a worker thread. The
+ * parser assigns pkgKeys itself and only queues rows, the workers insert
+ * them and build the indexes. package_writer_info_merge () copies the
+ * finished tables into the real database. */
+static void
+package_writer_info_init_parallel (UpdateInfo *update_info, sqlite3 *db,
+                                   GError **err)
+{
+    PackageWriterInfo *info = (PackageWriterInfo *) update_info;
+    const char *table;
+    sqlite3 *scratch;
+    YumDbBatch **handle = NULL;
+    YumDbBatch *batch;
+    gboolean is_dep;
+    guint i;
+
+    /*  The workers copy the index definitions from db. Creating them
+     * changes the schema, only prepare statements on db after this. */
+    update_info->index_tables (db, err);
+    if (*err)
+        return;
+
+    info->layout = yum_db_layout_open (db, err);
+    if (*err)
+        return;
+
+    for (i = 0; i < N_PRIMARY_TABLES; i++) {
+        table = i ? yum_db_primary_package_tables[i - 1] : "packages";
+        is_dep = i > 0 && strcmp (table, "files");
+
+        if (i > 0) {
+            handle = package_writer_handle (info, table);
+            if (!handle) {
+                g_set_error (err, YUM_DB_ERROR, YUM_DB_ERROR,
+                             "Can not write %s table", table);
+                return;
+            }
+        }
+
+        info->scratch_tables[i] = yum_db_layout_table (info->layout, table);
+
+        info->scratch_paths[i] = g_strdup_printf ("%s.%s",
+                                                  update_info->build_path,
+                                                  table);
+        scratch = yum_db_scratch_open (db, info->scratch_paths[i],
+                                       info->scratch_tables[i], err);
+        if (*err)
+            return;
+        info->scratch_dbs[i] = scratch;
+
+        if (i == 0)
+            batch = yum_db_package_batch_prepare (scratch, info->layout, err);
+        else if (is_dep)
+            batch = yum_db_dependency_prepare (scratch, table,
+                                               info->layout, err);
+        else
+            batch = yum_db_file_prepare (scratch, err);
+        if (*err)
+            return;
+        info->batches[i] = batch;
+        if (handle) {
+            *handle = batch;
+            yum_db_batch_set_sorted (batch,
+                                     update_info->options->sorted_load);
+        }
+
+        yum_db_batch_start (batch, db, err);
+        if (*err)
+            return;
+    }
+}
+
 static void
 package_writer_info_init (UpdateInfo *update_info, sqlite3 *db, GError **err)
 {
     PackageWriterInfo *info = (PackageWriterInfo *) update_info;
 
-    info->pkg_handle = yum_db_package_prepare (db, err);
+    /* With one CPU the threads only add the cost of the merge */
+    if (update_info->fresh_build && update_info->options->parallel &&
+        g_get_num_processors () > 1) {
+        package_writer_info_init_parallel (update_info, db, err);
+        return;
+    }
+
+    info->layout = yum_db_layout_open (db, err);
+    if (*err)
+        return;
+
+    info->pkg_handle = yum_db_package_prepare (db, info->layout, err);
     if (*err)
         return;
-    info->requires_handle = yum_db_dependency_prepare (db, "requires", err);
+    info->requires_handle = yum_db_dependency_prepare (db, "requires",
+                                                       info->layout, err);
     if (*err)
         return;
-    info->provides_handle = yum_db_dependency_prepare (db, "provides", err);
+    info->provides_handle = yum_db_dependency_prepare (db, "provides",
+                                                       info->layout, err);
     if (*err)
         return;
-    info->conflicts_handle = yum_db_dependency_prepare (db, "conflicts", err);
+    info->conflicts_handle = yum_db_dependency_prepare (db, "conflicts",
+                                                        info->layout, err);
     if (*err)
         return;
-    info->obsoletes_handle = yum_db_dependency_prepare (db, "obsoletes", err);
+    info->obsoletes_handle = yum_db_dependency_prepare (db, "obsoletes",
+                                                        info->layout, err);
     if (*err)
         return;
     info->files_handle = yum_db_file_prepare (db, err);
+    if (*err)
+        return;
+
+    if (update_info->options->sorted_load) {
+        yum_db_batch_set_sorted (info->requires_handle, TRUE);
+        yum_db_batch_set_sorted (info->provides_handle, TRUE);
+        yum_db_batch_set_sorted (info->conflicts_handle, TRUE);
+        yum_db_batch_set_sorted (info->obsoletes_handle, TRUE);
+        yum_db_batch_set_sorted (info->files_handle, TRUE);
+    }
 }
 
 static void
-write_deps (sqlite3 *db, sqlite3_stmt *handle, gint64 pkgKey, 
+write_deps (sqlite3 *db, YumDbBatch *handle, gint64 pkgKey,
             GSList *deps)
 {
     GSList *iter;
@@ -193,7 +342,7 @@ write_deps (sqlite3 *db, sqlite3_stmt *handle, gint64 pkgKey,
 }
 
 static void
-write_requirements (sqlite3 *db, sqlite3_stmt *handle, gint64 pkgKey,
+write_requirements (sqlite3 *db, YumDbBatch *handle, gint64 pkgKey,
             GSList *deps)
 {
     GSList *iter;
@@ -205,7 +354,7 @@ write_requirements (sqlite3 *db, sqlite3_stmt *handle, gint64 pkgKey,
 
 
 static void
-write_files (sqlite3 *db, sqlite3_stmt *handle, Package *pkg)
+write_files (sqlite3 *db, YumDbBatch *handle, Package *pkg)
 {
     GSList *iter;
 
@@ -219,7 +368,13 @@ write_package_to_db (UpdateInfo *update_info, Package *package)
 {
     PackageWriterInfo *info = (PackageWriterInfo *) update_info;
 
-    yum_db_package_write (update_info->db, info->pkg_handle, package);
+    if (info->batches[0]) {
+        package->pkgKey = ++info->last_pkgKey;
+        yum_db_package_batch_write (update_info->db, info->batches[0],
+                                    package);
+    } else
+        yum_db_package_write (update_info->db, info->pkg_handle,
+                              info->layout, package);
 
     write_requirements (update_info->db, info->requires_handle,
                     package->pkgKey, package->requires);
@@ -233,23 +388,106 @@ write_package_to_db (UpdateInfo *update_info, Package *package)
     write_files (update_info->db, info->files_handle, package);
 }
 
+static void
+package_writer_info_flush (UpdateInfo *update_info, GError **err)
+{
+    PackageWriterInfo *info = (PackageWriterInfo *) update_info;
+
+    if (info->batches[0]) {
+        yum_db_batch_flush (info->batches[0], err);
+        if (*err)
+            return;
+    }
+    yum_db_layout_flush (info->layout, err);
+    if (*err)
+        return;
+    yum_db_batch_flush (info->requires_handle, err);
+    if (*err)
+        return;
+    yum_db_batch_flush (info->provides_handle, err);
+    if (*err)
+        return;
+    yum_db_batch_flush (info->conflicts_handle, err);
+    if (*err)
+        return;
+    yum_db_batch_flush (info->obsoletes_handle, err);
+    if (*err)
+        return;
+    yum_db_batch_flush (info->files_handle, err);
+}
+
+static void
+package_writer_info_merge (UpdateInfo *update_info, GError **err)
+{
+    PackageWriterInfo *info = (PackageWriterInfo *) update_info;
+    GTimer *timer;
+    guint i;
+
+    if (!info->scratch_paths[0])
+        return;
+
+    /* Let every worker finish before merging, their indexes build at once */
+    for (i = 0; i < N_PRIMARY_TABLES; i++) {
+        yum_db_batch_join (info->batches[i], err);
+        if (*err)
+            return;
+    }
+
+    /* The scratch databases are locked for as long as they are open */
+    for (i = 0; i < N_PRIMARY_TABLES; i++) {
+        yum_db_batch_free (info->batches[i]);
+        info->batches[i] = NULL;
+        sqlite3_close (info->scratch_dbs[i]);
+        info->scratch_dbs[i] = NULL;
+    }
+
+    timer = g_timer_new ();
+    for (i = 0; i < N_PRIMARY_TABLES && !*err; i++)
+        yum_db_merge_table (update_info->db, info->scratch_paths[i],
+                            info->scratch_tables[i], err);
+
+    if (!*err)
+        g_debug ("Merged %d tables in %.2f seconds",
+                 (int) N_PRIMARY_TABLES, g_timer_elapsed (timer, NULL));
+    g_timer_destroy (timer);
+}
+
 static void
 package_writer_info_clean (UpdateInfo *update_info)
 {
     PackageWriterInfo *info = (PackageWriterInfo *) update_info;
+    guint i;
     
     if (info->pkg_handle)
         sqlite3_finalize (info->pkg_handle);
+    if (info->layout)
+        yum_db_layout_free (info->layout);
+
+    if (info->scratch_paths[0]) {
+        for (i = 0; i < N_PRIMARY_TABLES; i++) {
+            if (info->batches[i])
+                yum_db_batch_free (info->batches[i]);
+            if (info->scratch_dbs[i])
+                sqlite3_close (info->scratch_dbs[i]);
+            if (info->scratch_paths[i]) {
+                unlink (info->scratch_paths[i]);
+                g_free (info->scratch_paths[i]);
+            }
+            g_free (info->scratch_tables[i]);
+        }
+        return;
+    }
+
     if (info->requires_handle)
-        sqlite3_finalize (info->requires_handle);
+        yum_db_batch_free (info->requires_handle);
     if (info->provides_handle)
-        sqlite3_finalize (info->provides_handle);
+        yum_db_batch_free (info->provides_handle);
     if (info->conflicts_handle)
-        sqlite3_finalize (info->conflicts_handle);
+        yum_db_batch_free (info->conflicts_handle);
     if (info->obsoletes_handle)
-        sqlite3_finalize (info->obsoletes_handle);
+        yum_db_batch_free (info->obsoletes_handle);
     if (info->files_handle)
-        sqlite3_finalize (info->files_handle);
+        yum_db_batch_free (info->files_handle);
 }
 
 
@@ -257,8 +495,10 @@ package_writer_info_clean (UpdateInfo *update_info)
 
 typedef struct {
     UpdateInfo update_info;
+    YumDbLayout *layout;
     sqlite3_stmt *pkg_handle;
-    sqlite3_stmt *file_handle;
+    YumDbBatch *file_handle;
+    YumDbBatch *path_handle;        /* NULL without a path_index */
 } FileListInfo;
 
 static void
@@ -266,11 +506,44 @@ update_filelist_info_init (UpdateInfo *update_info, sqlite3 *db, GError **err)
 {
     FileListInfo *info = (FileListInfo *) update_info;
 
-    info->pkg_handle = yum_db_package_ids_prepare (db, err);
+    info->layout = yum_db_layout_open (db, err);
+    if (*err)
+        return;
+
+    info->pkg_handle = yum_db_package_ids_prepare (db, info->layout, err);
+    if (*err)
+        return;
+
+    info->file_handle = yum_db_filelists_prepare (db, info->layout, err);
+    if (*err)
+        return;
+
+    info->path_handle = yum_db_filepaths_prepare (db, info->layout, err);
+    if (*err)
+        return;
+
+    if (update_info->options->sorted_load) {
+        yum_db_batch_set_sorted (info->file_handle, TRUE);
+        if (info->path_handle)
+            yum_db_batch_set_sorted (info->path_handle, TRUE);
+    }
+}
+
+static void
+update_filelist_info_flush (UpdateInfo *update_info, GError **err)
+{
+    FileListInfo *info = (FileListInfo *) update_info;
+
+    yum_db_layout_flush (info->layout, err);
     if (*err)
         return;
 
-    info->file_handle = yum_db_filelists_prepare (db, err);
+    yum_db_batch_flush (info->file_handle, err);
+    if (*err)
+        return;
+
+    if (info->path_handle)
+        yum_db_batch_flush (info->path_handle, err);
 }
 
 static void
@@ -278,19 +551,58 @@ update_filelist_info_clean (UpdateInfo *update_info)
 {
     FileListInfo *info = (FileListInfo *) update_info;
 
+    if (info->layout)
+        yum_db_layout_free (info->layout);
     if (info->pkg_handle)
         sqlite3_finalize (info->pkg_handle);
     if (info->file_handle)
-        sqlite3_finalize (info->file_handle);
+        yum_db_batch_free (info->file_handle);
+    if (info->path_handle)
+        yum_db_batch_free (info->path_handle);
 }
 
+/*  Also writes the chunks of yum_xml_parse_filelists_chunked (), the
+ * package id only goes in with the first one. */
 static void
 write_filelist_package_to_db (UpdateInfo *update_info, Package *package)
 {
     FileListInfo *info = (FileListInfo *) update_info;
 
-    yum_db_package_ids_write (update_info->db, info->pkg_handle, package);
+    if (!package->pkgKey)
+        yum_db_package_ids_write (update_info->db, info->pkg_handle,
+                                  info->layout, package);
     yum_db_filelists_write (update_info->db, info->file_handle, package);
+    if (info->path_handle)
+        yum_db_filepaths_write (update_info->db, info->path_handle, package);
+}
+
+/*  Files of packages too big to hold at once, written as they come. Each
+ * chunk gets rows of its own, so a directory can have several filelist
+ * rows for a package, which readers already cope with. */
+static void
+update_package_chunk_cb (Package *p, gpointer user_data)
+{
+    UpdateInfo *update_info = (UpdateInfo *) user_data;
+
+    if (p->pkgId == NULL)
+        return;
+
+    if (update_info->fresh_build ||
+        g_hash_table_lookup (update_info->current_packages, p->pkgId) == NULL)
+        update_info->write_package (update_info, p);
+}
+
+static void
+parse_filelists (const char *filename,
+                 CountFn count_callback,
+                 PackageFn package_callback,
+                 gpointer user_data,
+                 GError **err)
+{
+    yum_xml_parse_filelists_chunked (filename, count_callback,
+                                     package_callback,
+                                     update_package_chunk_cb,
+                                     user_data, err);
 }
 
 
@@ -298,30 +610,46 @@ write_filelist_package_to_db (UpdateInfo *update_info, Package *package)
 
 typedef struct {
     UpdateInfo update_info;
+    YumDbLayout *layout;
     sqlite3_stmt *pkg_handle;
-    sqlite3_stmt *changelog_handle;
+    YumDbBatch *changelog_handle;
 } UpdateOtherInfo;
 
 static void
 update_other_info_init (UpdateInfo *update_info, sqlite3 *db, GError **err)
 {
     UpdateOtherInfo *info = (UpdateOtherInfo *) update_info;
-    info->pkg_handle = yum_db_package_ids_prepare (db, err);
+
+    info->layout = yum_db_layout_open (db, err);
+    if (*err)
+        return;
+
+    info->pkg_handle = yum_db_package_ids_prepare (db, info->layout, err);
     if (*err)
         return;
 
     info->changelog_handle = yum_db_changelog_prepare (db, err);
 }
 
+static void
+update_other_info_flush (UpdateInfo *update_info, GError **err)
+{
+    UpdateOtherInfo *info = (UpdateOtherInfo *) update_info;
+
+    yum_db_batch_flush (info->changelog_handle, err);
+}
+
 static void
 update_other_info_clean (UpdateInfo *update_info)
 {
     UpdateOtherInfo *info = (UpdateOtherInfo *) update_info;
 
+    if (info->layout)
+        yum_db_layout_free (info->layout);
     if (info->pkg_handle)
         sqlite3_finalize (info->pkg_handle);
     if (info->changelog_handle)
-        sqlite3_finalize (info->changelog_handle);
+        yum_db_batch_free (info->changelog_handle);
 }
 
 static void
@@ -329,7 +657,8 @@ write_other_package_to_db (UpdateInfo *update_info, Package *package)
 {
     UpdateOtherInfo *info = (UpdateOtherInfo *) update_info;
 
-    yum_db_package_ids_write (update_info->db, info->pkg_handle, package);
+    yum_db_package_ids_write (update_info->db, info->pkg_handle,
+                              info->layout, package);
     yum_db_changelog_write (update_info->db, info->changelog_handle, package);
 }
 
@@ -366,16 +695,20 @@ update_package_cb (Package *p, gpointer user_data)
         return;
     }
 
-    g_hash_table_insert (update_info->all_packages,
-                         g_string_chunk_insert (update_info->package_ids_chunk,
-                                                p->pkgId),
-                         GINT_TO_POINTER (1));
-
-    if (g_hash_table_lookup (update_info->current_packages,
-                             p->pkgId) == NULL) {
-        
+    if (update_info->fresh_build) {
         update_info->write_package (update_info, p);
         update_info->add_count++;
+    } else {
+        g_hash_table_insert (update_info->all_packages,
+                             g_string_chunk_insert (update_info->package_ids_chunk,
+                                                    p->pkgId),
+                             GINT_TO_POINTER (1));
+
+        if (g_hash_table_lookup (update_info->current_packages,
+                                 p->pkgId) == NULL) {
+            update_info->write_package (update_info, p);
+            update_info->add_count++;
+        }
     }
 
     if (update_info->count_from_md > 0 && update_info->python_callback) {
@@ -384,19 +717,115 @@ update_package_cb (Package *p, gpointer user_data)
     }
 }
 
+/*  How much larger than their files compressed metadata is taken to be
+ * when the file does not say, about the most the repodata tools get. */
+#define YMP_CONFIG_COMPRESSION_RATIO 10
+
+/*  The size of the metadata in md_filename once uncompressed, which the
+ * cache built from it comes close to. gzip files end with it (modulo
+ * 4GB), other compressed files are assumed YMP_CONFIG_COMPRESSION_RATIO
+ * times their size. -1 on errors. */
+static gint64
+metadata_size (const char *md_filename)
+{
+    static const guchar gzip_magic[] = { 0x1f, 0x8b };
+    static const guchar bzip2_magic[] = { 'B', 'Z', 'h' };
+    static const guchar xz_magic[] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+    guchar head[6];
+    guchar tail[4];
+    gint64 size;
+    gint64 isize;
+    FILE *f;
+
+    f = fopen (md_filename, "r");
+    if (!f)
+        return -1;
+
+    if (fseek (f, 0, SEEK_END) < 0 || (size = ftell (f)) < 0) {
+        fclose (f);
+        return -1;
+    }
+
+    rewind (f);
+    if (fread (head, 1, sizeof (head), f) != sizeof (head)) {
+        fclose (f);
+        return size;
+    }
+
+    if (!memcmp (head, gzip_magic, sizeof (gzip_magic)) &&
+        fseek (f, -4, SEEK_END) == 0 &&
+        fread (tail, 1, sizeof (tail), f) == sizeof (tail)) {
+        isize = (gint64) tail[0] | (gint64) tail[1] << 8 |
+            (gint64) tail[2] << 16 | (gint64) tail[3] << 24;
+        /* ISIZE below the compressed size means it wrapped, over 4GB */
+        if (isize >= size)
+            size = isize;
+        else
+            size *= YMP_CONFIG_COMPRESSION_RATIO;
+    } else if (!memcmp (head, bzip2_magic, sizeof (bzip2_magic)) ||
+               !memcmp (head, xz_magic, sizeof (xz_magic)))
+        size *= YMP_CONFIG_COMPRESSION_RATIO;
+
+    fclose (f);
+
+    return size;
+}
+
+/*  Whether to build in memory: when the uncompressed metadata, and so
+ * about the database, is within YumDbOptions.memory_limit. */
+static gboolean
+build_in_memory (const char *md_filename, const YumDbOptions *options)
+{
+    gint64 size;
+
+    if (options->memory_limit <= 0)
+        return FALSE;
+
+    size = metadata_size (md_filename);
+
+    return size >= 0 && size <= options->memory_limit;
+}
+
+/*  Files written next to a cache from the finished database, each when
+ * the YumDbOptions gboolean at option is set. */
+typedef gboolean (*SidecarWriteFn) (sqlite3 *db,
+                                    const char *path,
+                                    GError **err);
+
+static const struct {
+    const char *suffix;
+    glong option;
+    SidecarWriteFn write;
+} sidecars[] = {
+    { ".bloom", G_STRUCT_OFFSET (YumDbOptions, bloom_filter),
+      yum_db_write_bloom },
+    { ".hidx", G_STRUCT_OFFSET (YumDbOptions, hash_index),
+      yum_db_write_hash_index },
+};
+
 static char *
 update_packages (UpdateInfo *update_info,
                  const char *md_filename,
                  const char *checksum,
+                 const YumDbOptions *options,
                  gpointer python_callback,
                  gpointer user_data,
                  GError **err)
 {
     char *db_filename;
+    char *build_filename = NULL;
+    char *sidecar_filenames[G_N_ELEMENTS (sidecars)] = { NULL };
+    char *sidecar_builds[G_N_ELEMENTS (sidecars)] = { NULL };
+    guint i;
+
+    update_info->options = options;
 
     db_filename = yum_db_filename (md_filename);
     update_info->db = yum_db_open (db_filename, checksum,
                                    update_info->create_tables,
+                                   options,
+                                   build_in_memory (md_filename, options),
+                                   &build_filename,
                                    err);
 
     if (*err)
@@ -405,6 +834,17 @@ update_packages (UpdateInfo *update_info,
     if (!update_info->db)
         return db_filename;
 
+    /*  A sidecar left from before would miss whatever the cache gains
+     * now, it goes before the cache changes. */
+    for (i = 0; i < G_N_ELEMENTS (sidecars); i++) {
+        sidecar_filenames[i] = g_strconcat (db_filename, sidecars[i].suffix,
+                                            NULL);
+        unlink (sidecar_filenames[i]);
+    }
+
+    /* Only a rebuild from scratch hands back a scratch file to rename */
+    update_info->fresh_build = build_filename != NULL;
+    update_info->build_path = build_filename;
     update_info_init (update_info, err);
     if (*err)
         goto cleanup;
@@ -422,6 +862,9 @@ update_packages (UpdateInfo *update_info,
                             update_package_cb,
                             update_info,
                             err);
+    if (*err)
+        goto cleanup;
+    update_info->info_flush (update_info, err);
     if (*err)
         goto cleanup;
     sqlite3_exec (update_info->db, "COMMIT", NULL, NULL, NULL);
@@ -430,15 +873,57 @@ update_packages (UpdateInfo *update_info,
     if (*err)
         goto cleanup;
 
-    update_info_remove_old_entries (update_info);
+    if (update_info->info_merge) {
+        update_info->info_merge (update_info, err);
+        if (*err)
+            goto cleanup;
+    }
+
+    /*  The removal triggers would fire on nothing during a bulk load, add
+     * them once the rows are in. */
+    update_info->create_triggers (update_info->db, err);
+    if (*err)
+        goto cleanup;
+
+    if (!update_info->fresh_build) {
+        update_info_remove_old_entries (update_info, err);
+        if (*err)
+            goto cleanup;
+    }
+
     yum_db_dbinfo_update (update_info->db, checksum, err);
+    if (*err)
+        goto cleanup;
+
+    /* Put in place next to the cache once that is */
+    for (i = 0; i < G_N_ELEMENTS (sidecars) && !*err; i++) {
+        if (!G_STRUCT_MEMBER (gboolean, options, sidecars[i].option))
+            continue;
+
+        sidecar_builds[i] = g_strconcat (sidecar_filenames[i], ".new", NULL);
+        if (!sidecars[i].write (update_info->db, sidecar_builds[i], err)) {
+            unlink (sidecar_builds[i]);
+            g_free (sidecar_builds[i]);
+            sidecar_builds[i] = NULL;
+        }
+    }
 
  cleanup:
     update_info->info_clean (update_info);
     update_info_done (update_info, err);
 
     if (update_info->db)
-        sqlite3_close (update_info->db);
+        yum_db_close (update_info->db, db_filename, build_filename, err);
+    g_free (build_filename);
+
+    for (i = 0; i < G_N_ELEMENTS (sidecars); i++) {
+        if (sidecar_builds[i]) {
+            if (*err || rename (sidecar_builds[i], sidecar_filenames[i]) < 0)
+                unlink (sidecar_builds[i]);
+            g_free (sidecar_builds[i]);
+        }
+        g_free (sidecar_filenames[i]);
+    }
 
     if (*err) {
         g_free (db_filename);
@@ -450,18 +935,88 @@ update_packages (UpdateInfo *update_info,
 
 /*********************************************************************/
 
+static gboolean
+py_parse_options (PyObject *dict, YumDbOptions *options)
+{
+    PyObject *key;
+    PyObject *value;
+    Py_ssize_t pos = 0;
+    const char *name;
+
+    yum_db_options_init (options);
+
+    if (!dict || dict == Py_None)
+        return TRUE;
+
+    if (!PyDict_Check (dict)) {
+        PyErr_SetString (PyExc_TypeError, "options must be a dict");
+        return FALSE;
+    }
+
+    while (PyDict_Next (dict, &pos, &key, &value)) {
+        name = PyString_AsString (key);
+        if (!name)
+            return FALSE;
+
+        if (!strcmp (name, "memory_limit"))
+            options->memory_limit = PyLong_AsLongLong (value);
+        else if (!strcmp (name, "sorted_load"))
+            options->sorted_load = PyObject_IsTrue (value);
+        else if (!strcmp (name, "parallel"))
+            options->parallel = PyObject_IsTrue (value);
+        else if (!strcmp (name, "normalize_deps"))
+            options->normalize_deps = PyObject_IsTrue (value);
+        else if (!strcmp (name, "compact_types"))
+            options->compact_types = PyObject_IsTrue (value);
+        else if (!strcmp (name, "dictionary_columns"))
+            options->dictionary_columns = PyObject_IsTrue (value);
+        else if (!strcmp (name, "normalize_dirs"))
+            options->normalize_dirs = PyObject_IsTrue (value);
+        else if (!strcmp (name, "front_code_files"))
+            options->front_code_files = PyObject_IsTrue (value);
+        else if (!strcmp (name, "compress_files"))
+            options->compress_files = PyObject_IsTrue (value);
+        else if (!strcmp (name, "path_index"))
+            options->path_index = PyObject_IsTrue (value);
+        else if (!strcmp (name, "search_index"))
+            options->search_index = PyObject_IsTrue (value);
+        else if (!strcmp (name, "bloom_filter"))
+            options->bloom_filter = PyObject_IsTrue (value);
+        else if (!strcmp (name, "hash_index"))
+            options->hash_index = PyObject_IsTrue (value);
+        else if (!strcmp (name, "evr_columns"))
+            options->evr_columns = PyObject_IsTrue (value);
+        else if (!strcmp (name, "summary_tables"))
+            options->summary_tables = PyObject_IsTrue (value);
+        else {
+            PyErr_Format (PyExc_TypeError, "unknown option '%s'", name);
+            return FALSE;
+        }
+
+        if (PyErr_Occurred ())
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
 static gboolean
 py_parse_args (PyObject *args,
                const char **md_filename,
                const char **checksum,
                PyObject **log,
                PyObject **progress,
-               PyObject **repoid)
+               PyObject **repoid,
+               YumDbOptions *options)
 {
     PyObject *callback;
+    PyObject *dict = NULL;
 
-    if (!PyArg_ParseTuple (args, "ssOO", md_filename, checksum, &callback,
-                           repoid))
+    if (!PyArg_ParseTuple (args, "ssOO|O", md_filename, checksum, &callback,
+                           repoid, &dict))
+        return FALSE;
+
+    if (!py_parse_options (dict, options))
         return FALSE;
 
     if (PyObject_HasAttrString (callback, "log")) {
@@ -533,13 +1088,14 @@ py_update (PyObject *self, PyObject *args, UpdateInfo *update_info)
     PyObject *log = NULL;
     PyObject *progress = NULL;
     PyObject *repoid = NULL;
+    YumDbOptions options;
     guint log_id = 0;
     char *db_filename;
     PyObject *ret = NULL;
     GError *err = NULL;
 
     if (!py_parse_args (args, &md_filename, &checksum, &log, &progress,
-                        &repoid))
+                        &repoid, &options))
         return NULL;
 
     GLogLevelFlags level = G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_WARNING |
@@ -547,7 +1103,7 @@ py_update (PyObject *self, PyObject *args, UpdateInfo *update_info)
     log_id = g_log_set_handler (NULL, level, log_cb, log);
 
     db_filename = update_packages (update_info, md_filename, checksum,
-                                   progress, repoid, &err);
+                                   &options, progress, repoid, &err);
 
     g_log_remove_handler (NULL, log_id);
 
@@ -569,11 +1125,15 @@ py_update_primary (PyObject *self, PyObject *args)
     memset (&info, 0, sizeof (PackageWriterInfo));
 
     info.update_info.info_init = package_writer_info_init;
+    info.update_info.info_flush = package_writer_info_flush;
+    info.update_info.info_merge = package_writer_info_merge;
     info.update_info.info_clean = package_writer_info_clean;
     info.update_info.create_tables = yum_db_create_primary_tables;
     info.update_info.write_package = write_package_to_db;
     info.update_info.xml_parse = yum_xml_parse_primary;
     info.update_info.index_tables = yum_db_index_primary_tables;
+    info.update_info.create_triggers = yum_db_create_primary_triggers;
+    info.update_info.remove_packages = yum_db_remove_primary_packages;
 
     return py_update (self, args, (UpdateInfo *) &info);
 }
@@ -585,11 +1145,14 @@ py_update_filelist (PyObject *self, PyObject *args)
     memset (&info, 0, sizeof (FileListInfo));
 
     info.update_info.info_init = update_filelist_info_init;
+    info.update_info.info_flush = update_filelist_info_flush;
     info.update_info.info_clean = update_filelist_info_clean;
     info.update_info.create_tables = yum_db_create_filelist_tables;
     info.update_info.write_package = write_filelist_package_to_db;
-    info.update_info.xml_parse = yum_xml_parse_filelists;
+    info.update_info.xml_parse = parse_filelists;
     info.update_info.index_tables = yum_db_index_filelist_tables;
+    info.update_info.create_triggers = yum_db_create_filelist_triggers;
+    info.update_info.remove_packages = yum_db_remove_filelist_packages;
 
     return py_update (self, args, (UpdateInfo *) &info);
 }
@@ -601,32 +1164,1687 @@ py_update_other (PyObject *self, PyObject *args)
     memset (&info, 0, sizeof (UpdateOtherInfo));
 
     info.update_info.info_init = update_other_info_init;
+    info.update_info.info_flush = update_other_info_flush;
     info.update_info.info_clean = update_other_info_clean;
     info.update_info.create_tables = yum_db_create_other_tables;
     info.update_info.write_package = write_other_package_to_db;
     info.update_info.xml_parse = yum_xml_parse_other;
     info.update_info.index_tables = yum_db_index_other_tables;
+    info.update_info.create_triggers = yum_db_create_other_triggers;
+    info.update_info.remove_packages = yum_db_remove_other_packages;
 
     return py_update (self, args, (UpdateInfo *) &info);
 }
 
-static PyMethodDef SqliteMethods[] = {
-    {"update_primary", py_update_primary, METH_VARARGS,
-     "Parse YUM primary.xml metadata."},
-    {"update_filelist", py_update_filelist, METH_VARARGS,
-     "Parse YUM filelists.xml metadata."},
-    {"update_other", py_update_other, METH_VARARGS,
-     "Parse YUM other.xml metadata."},
+/*  The text of filenames, a filelist row's filenames column, decoded
+ * when the front_code_files layout stored it as a blob. NULL with an
+ * exception set when it can not be decoded. */
+static const char *
+filenames_text (PyObject *filenames, Py_ssize_t *len)
+{
+    static GString *names = NULL;
+    const void *data;
+    char *text;
 
-    {NULL, NULL, 0, NULL}
-};
+    if (PyString_Check (filenames)) {
+        PyString_AsStringAndSize (filenames, &text, len);
+        return text;
+    }
 
-PyMODINIT_FUNC
-init_sqlitecache (void)
+    if (PyObject_AsReadBuffer (filenames, &data, len) < 0)
+        return NULL;
+
+    /* Only ever used holding the GIL */
+    if (!names)
+        names = g_string_sized_new (4096);
+
+    if (!yum_filenames_decode (data, *len, names)) {
+        PyErr_SetString (PyExc_ValueError, "Can not decode filenames");
+        return NULL;
+    }
+
+    *len = names->len;
+    return names->str;
+}
+
+/*  ymp_filenames () of the front_code_files layout, which
+ * sqlitecachec.open_database () registers with the connection. Filenames
+ * stored as TEXT come back as they are. */
+static PyObject *
+py_decode_filenames (PyObject *self, PyObject *args)
 {
-    PyObject * m, * d;
+    PyObject *blob;
+    const char *names;
+    Py_ssize_t len;
 
-    m = Py_InitModule ("_sqlitecache", SqliteMethods);
+    if (!PyArg_ParseTuple (args, "O:decode_filenames", &blob))
+        return NULL;
+
+    if (blob == Py_None || PyString_Check (blob) || PyUnicode_Check (blob)) {
+        Py_INCREF (blob);
+        return blob;
+    }
+
+    names = filenames_text (blob, &len);
+    if (!names)
+        return NULL;
+
+    return PyString_FromStringAndSize (names, len);
+}
+
+/*  evr_key (epoch, version, release), the evr column of the evr_columns
+ * layout as a buffer, so it binds as a BLOB and compares with the column.
+ * sqlitecachec.open_database () registers it as ymp_evr_key (). */
+static PyObject *
+py_evr_key (PyObject *self, PyObject *args)
+{
+    const char *epoch;
+    const char *version;
+    const char *release;
+    PyObject *key;
+    PyObject *buffer;
+    GString *str;
+
+    if (!PyArg_ParseTuple (args, "zzz:evr_key", &epoch, &version, &release))
+        return NULL;
+
+    str = g_string_sized_new (64);
+    yum_evr_sort_key (epoch, version, release, str);
+    key = PyString_FromStringAndSize (str->str, str->len);
+    g_string_free (str, TRUE);
+    if (!key)
+        return NULL;
+
+    buffer = PyBuffer_FromObject (key, 0, Py_END_OF_BUFFER);
+    Py_DECREF (key);
+
+    return buffer;
+}
+
+/*  args with the unicode objects, as which SQLite hands text to Python
+ * functions, encoded in UTF-8 for the "z" format. A new reference, NULL
+ * with an exception set on errors. */
+static PyObject *
+utf8_args (PyObject *args)
+{
+    PyObject *utf8;
+    PyObject *item;
+    Py_ssize_t i;
+
+    utf8 = PyTuple_New (PyTuple_GET_SIZE (args));
+    if (!utf8)
+        return NULL;
+
+    for (i = 0; i < PyTuple_GET_SIZE (args); i++) {
+        item = PyTuple_GET_ITEM (args, i);
+        if (PyUnicode_Check (item))
+            item = PyUnicode_AsUTF8String (item);
+        else
+            Py_INCREF (item);
+        if (!item) {
+            Py_DECREF (utf8);
+            return NULL;
+        }
+        PyTuple_SET_ITEM (utf8, i, item);
+    }
+
+    return utf8;
+}
+
+/*  rpmvercmp (a, b), -1, 0 or 1 as rpm compares the two versions, None if
+ * either is. sqlitecachec.open_database () registers it and the two
+ * below with the connection, like ymp-sqlite.c has them. */
+static PyObject *
+py_rpmvercmp (PyObject *self, PyObject *args)
+{
+    const char *a;
+    const char *b;
+    PyObject *result = NULL;
+
+    args = utf8_args (args);
+    if (!args)
+        return NULL;
+
+    if (PyArg_ParseTuple (args, "zz:rpmvercmp", &a, &b)) {
+        if (a && b)
+            result = PyInt_FromLong (yum_rpmvercmp (a, b));
+        else {
+            Py_INCREF (Py_None);
+            result = Py_None;
+        }
+    }
+    Py_DECREF (args);
+
+    return result;
+}
+
+/*  evr_cmp (e1, v1, r1, e2, v2, r2), where None epochs are 0 and a None
+ * release matches any. */
+static PyObject *
+py_evr_cmp (PyObject *self, PyObject *args)
+{
+    const char *evr[6];
+    PyObject *result = NULL;
+
+    args = utf8_args (args);
+    if (!args)
+        return NULL;
+
+    if (PyArg_ParseTuple (args, "zzzzzz:evr_cmp", &evr[0], &evr[1], &evr[2],
+                          &evr[3], &evr[4], &evr[5]))
+        result = PyInt_FromLong (yum_evr_cmp (evr[0], evr[1], evr[2],
+                                              evr[3], evr[4], evr[5]));
+    Py_DECREF (args);
+
+    return result;
+}
+
+/*  filelist_contains (dirname, filenames, path), whether path is one of
+ * the files of a filelist row, None if any argument is. */
+static PyObject *
+py_filelist_contains (PyObject *self, PyObject *args)
+{
+    const char *dirname;
+    PyObject *filenames;
+    const char *path;
+    const char *name;
+    const char *names;
+    Py_ssize_t len;
+    PyObject *result = NULL;
+
+    args = utf8_args (args);
+    if (!args)
+        return NULL;
+
+    if (!PyArg_ParseTuple (args, "zOz:filelist_contains",
+                           &dirname, &filenames, &path))
+        goto cleanup;
+
+    if (!dirname || filenames == Py_None || !path) {
+        Py_INCREF (Py_None);
+        result = Py_None;
+        goto cleanup;
+    }
+
+    name = yum_filenames_path_name (dirname, path);
+    if (!name) {
+        result = PyInt_FromLong (0);
+        goto cleanup;
+    }
+
+    names = filenames_text (filenames, &len);
+    if (names)
+        result = PyInt_FromLong (yum_filenames_contain (names, len,
+                                                        name, strlen (name)));
+
+ cleanup:
+    Py_DECREF (args);
+
+    return result;
+}
+
+static void
+lookup_path_cb (guint path, gint64 pkgKey, char type, gpointer user_data)
+{
+    PyObject **found = (PyObject **) user_data;
+    PyObject *owner;
+
+    if (!found[path]) {
+        found[path] = PyList_New (0);
+        if (!found[path])
+            return;
+    }
+
+    owner = Py_BuildValue ("(Ls#)", (PY_LONG_LONG) pkgKey, &type,
+                           type ? 1 : 0);
+    if (owner) {
+        PyList_Append (found[path], owner);
+        Py_DECREF (owner);
+    }
+}
+
+/*  lookup_paths (filename, paths) -> {path: [(pkgKey, type), ...]} for the
+ * paths some package of a filelists cache built with path_index owns. */
+static PyObject *
+py_lookup_paths (PyObject *self, PyObject *args)
+{
+    const char *filename;
+    PyObject *seq;
+    PyObject *fast = NULL;
+    PyObject *ret = NULL;
+    PyObject **found = NULL;
+    const char **paths = NULL;
+    Py_ssize_t n, i;
+    sqlite3 *db = NULL;
+    GError *err = NULL;
+
+    if (!PyArg_ParseTuple (args, "sO:lookup_paths", &filename, &seq))
+        return NULL;
+
+    fast = PySequence_Fast (seq, "paths must be a sequence");
+    if (!fast)
+        return NULL;
+
+    n = PySequence_Fast_GET_SIZE (fast);
+    paths = g_new0 (const char *, n + 1);
+    found = g_new0 (PyObject *, n + 1);
+    for (i = 0; i < n; i++) {
+        paths[i] = PyString_AsString (PySequence_Fast_GET_ITEM (fast, i));
+        if (!paths[i])
+            goto cleanup;
+    }
+
+    if (sqlite3_open_v2 (filename, &db, SQLITE_OPEN_READONLY, NULL) !=
+        SQLITE_OK) {
+        PyErr_Format (PyExc_IOError, "Can not open %s: %s", filename,
+                      sqlite3_errmsg (db));
+        goto cleanup;
+    }
+    yum_db_register_functions (db);
+
+    yum_db_lookup_paths (db, paths, n, lookup_path_cb, found, &err);
+    if (err) {
+        PyErr_SetString (PyExc_TypeError, err->message);
+        g_error_free (err);
+        goto cleanup;
+    }
+    if (PyErr_Occurred ())
+        goto cleanup;
+
+    ret = PyDict_New ();
+    for (i = 0; ret && i < n; i++) {
+        if (found[i] &&
+            PyDict_SetItem (ret, PySequence_Fast_GET_ITEM (fast, i),
+                            found[i]) < 0) {
+            Py_DECREF (ret);
+            ret = NULL;
+        }
+    }
+
+ cleanup:
+    if (db)
+        sqlite3_close (db);
+    for (i = 0; found && i < n; i++)
+        Py_XDECREF (found[i]);
+    g_free (found);
+    g_free (paths);
+    Py_DECREF (fast);
+
+    return ret;
+}
+
+static void
+search_cb (gint64 pkgKey, double score, gpointer user_data)
+{
+    PyObject *found = (PyObject *) user_data;
+    PyObject *hit;
+
+    hit = Py_BuildValue ("(Ld)", (PY_LONG_LONG) pkgKey, score);
+    if (hit) {
+        PyList_Append (found, hit);
+        Py_DECREF (hit);
+    }
+}
+
+/*  search_packages (filename, term, limit=0) -> [(pkgKey, score), ...] of
+ * the packages of a primary cache whose summary or description contains
+ * term, best first. */
+static PyObject *
+py_search_packages (PyObject *self, PyObject *args)
+{
+    const char *filename;
+    const char *term;
+    int limit = 0;
+    PyObject *found;
+    sqlite3 *db = NULL;
+    GError *err = NULL;
+
+    if (!PyArg_ParseTuple (args, "ss|i:search_packages",
+                           &filename, &term, &limit))
+        return NULL;
+
+    if (sqlite3_open_v2 (filename, &db, SQLITE_OPEN_READONLY, NULL) !=
+        SQLITE_OK) {
+        PyErr_Format (PyExc_IOError, "Can not open %s: %s", filename,
+                      sqlite3_errmsg (db));
+        sqlite3_close (db);
+        return NULL;
+    }
+    yum_db_register_functions (db);
+
+    found = PyList_New (0);
+    if (found)
+        yum_db_search_packages (db, term, limit, search_cb, found, &err);
+    sqlite3_close (db);
+
+    if (err) {
+        PyErr_SetString (PyExc_TypeError, err->message);
+        g_error_free (err);
+        Py_XDECREF (found);
+        return NULL;
+    }
+
+    if (PyErr_Occurred ()) {
+        Py_XDECREF (found);
+        return NULL;
+    }
+
+    return found;
+}
+
+static void
+resolve_cb (const YumDepsolvePackage *package,
+            const Dependency *require,
+            const YumDepsolvePackage *providers,
+            guint n_providers,
+            gpointer user_data)
+{
+    PyObject *found = (PyObject *) user_data;
+    PyObject *provided;
+    PyObject *item;
+    guint i;
+
+    if (PyErr_Occurred ())
+        return;
+
+    provided = PyTuple_New (n_providers);
+    for (i = 0; provided && i < n_providers; i++) {
+        item = Py_BuildValue ("(IL)", providers[i].cache,
+                              (PY_LONG_LONG) providers[i].pkgKey);
+        if (!item) {
+            Py_DECREF (provided);
+            return;
+        }
+        PyTuple_SET_ITEM (provided, i, item);
+    }
+    if (!provided)
+        return;
+
+    item = Py_BuildValue ("(IL(zzzzz)N)", package->cache,
+                          (PY_LONG_LONG) package->pkgKey,
+                          require->name, require->flags, require->epoch,
+                          require->version, require->release, provided);
+    if (item) {
+        PyList_Append (found, item);
+        Py_DECREF (item);
+    }
+}
+
+/*  resolve_requires (primaries, packages) -> [(cache, pkgKey, (name, flags,
+ * epoch, version, release), ((cache, pkgKey), ...)), ...] for every require
+ * of the packages, given as (cache, pkgKey) pairs or NEVRA strings, with
+ * the packages of the primaries providing it. Unresolved requires have no
+ * providers. cache is an index in primaries. */
+static PyObject *
+py_resolve_requires (PyObject *self, PyObject *args)
+{
+    PyObject *primaries_seq;
+    PyObject *packages_seq;
+    PyObject *primaries = NULL;
+    PyObject *packages = NULL;
+    PyObject *found = NULL;
+    const char **paths = NULL;
+    YumDepsolve *depsolve = NULL;
+    Py_ssize_t n, i;
+    GError *err = NULL;
+
+    if (!PyArg_ParseTuple (args, "OO:resolve_requires",
+                           &primaries_seq, &packages_seq))
+        return NULL;
+
+    primaries = PySequence_Fast (primaries_seq, "primaries must be a sequence");
+    if (!primaries)
+        return NULL;
+    packages = PySequence_Fast (packages_seq, "packages must be a sequence");
+    if (!packages)
+        goto cleanup;
+
+    n = PySequence_Fast_GET_SIZE (primaries);
+    paths = g_new0 (const char *, n + 1);
+    for (i = 0; i < n; i++) {
+        paths[i] = PyString_AsString (PySequence_Fast_GET_ITEM (primaries, i));
+        if (!paths[i])
+            goto cleanup;
+    }
+
+    depsolve = yum_depsolve_new (paths, n, &err);
+    if (err)
+        goto cleanup;
+
+    for (i = 0; i < PySequence_Fast_GET_SIZE (packages); i++) {
+        PyObject *package = PySequence_Fast_GET_ITEM (packages, i);
+        unsigned int cache;
+        PY_LONG_LONG pkgKey;
+
+        if (PyString_Check (package)) {
+            if (!yum_depsolve_add_nevra (depsolve,
+                                         PyString_AS_STRING (package), &err)
+                && !err) {
+                PyErr_Format (PyExc_ValueError, "No package %s",
+                              PyString_AS_STRING (package));
+                goto cleanup;
+            }
+            if (err)
+                goto cleanup;
+            continue;
+        }
+
+        if (!PyArg_ParseTuple (package, "IL", &cache, &pkgKey))
+            goto cleanup;
+        if (cache >= (unsigned int) n) {
+            PyErr_Format (PyExc_ValueError, "No primary %u", cache);
+            goto cleanup;
+        }
+        yum_depsolve_add (depsolve, cache, pkgKey);
+    }
+
+    found = PyList_New (0);
+    if (found)
+        yum_depsolve_run (depsolve, resolve_cb, found, &err);
+    if (PyErr_Occurred ()) {
+        Py_XDECREF (found);
+        found = NULL;
+    }
+
+ cleanup:
+    if (err) {
+        PyErr_SetString (PyExc_TypeError, err->message);
+        g_error_free (err);
+        Py_XDECREF (found);
+        found = NULL;
+    }
+    if (depsolve)
+        yum_depsolve_free (depsolve);
+    g_free (paths);
+    Py_XDECREF (packages);
+    Py_DECREF (primaries);
+
+    return found;
+}
+
+/* BloomFilter (path), the sidecar the bloom_filter option writes */
+typedef struct {
+    PyObject_HEAD
+    YumBloom *bloom;
+} PyBloomFilter;
+
+static int
+py_bloom_filter_init (PyBloomFilter *self, PyObject *args, PyObject *kwds)
+{
+    const char *path;
+    GError *err = NULL;
+
+    if (!PyArg_ParseTuple (args, "s:BloomFilter", &path))
+        return -1;
+
+    if (self->bloom) {
+        yum_bloom_free (self->bloom);
+        self->bloom = NULL;
+    }
+
+    self->bloom = yum_bloom_open (path, &err);
+    if (err) {
+        PyErr_SetString (PyExc_IOError, err->message);
+        g_error_free (err);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+py_bloom_filter_dealloc (PyBloomFilter *self)
+{
+    if (self->bloom)
+        yum_bloom_free (self->bloom);
+    self->ob_type->tp_free ((PyObject *) self);
+}
+
+static int
+py_bloom_filter_contains (PyBloomFilter *self, PyObject *key)
+{
+    char *data;
+    Py_ssize_t len;
+
+    if (!self->bloom) {
+        PyErr_SetString (PyExc_ValueError, "BloomFilter is not open");
+        return -1;
+    }
+
+    if (PyString_AsStringAndSize (key, &data, &len) < 0)
+        return -1;
+
+    return yum_bloom_may_contain (self->bloom, data, len);
+}
+
+static PyObject *
+py_bloom_filter_may_contain (PyBloomFilter *self, PyObject *args)
+{
+    PyObject *key;
+    int found;
+
+    if (!PyArg_ParseTuple (args, "O:may_contain", &key))
+        return NULL;
+
+    found = py_bloom_filter_contains (self, key);
+    if (found < 0)
+        return NULL;
+
+    return PyBool_FromLong (found);
+}
+
+static PyMethodDef py_bloom_filter_methods[] = {
+    {"may_contain", (PyCFunction) py_bloom_filter_may_contain, METH_VARARGS,
+     "False if no provide or file of the cache is named key."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PySequenceMethods py_bloom_filter_sequence = {
+    0, 0, 0, 0, 0, 0, 0,
+    (objobjproc) py_bloom_filter_contains,  /* sq_contains */
+};
+
+static PyTypeObject PyBloomFilterType = {
+    PyObject_HEAD_INIT (NULL)
+    0,                                      /* ob_size */
+    "_sqlitecache.BloomFilter",             /* tp_name */
+    sizeof (PyBloomFilter),                 /* tp_basicsize */
+    0,                                      /* tp_itemsize */
+    (destructor) py_bloom_filter_dealloc,   /* tp_dealloc */
+    0, 0, 0, 0, 0, 0,
+    &py_bloom_filter_sequence,              /* tp_as_sequence */
+    0, 0, 0, 0, 0, 0, 0,
+    Py_TPFLAGS_DEFAULT,                     /* tp_flags */
+    "Bloom filter of a cache's provides and files, opened from its "
+    ".bloom sidecar.",                      /* tp_doc */
+    0, 0, 0, 0, 0, 0,
+    py_bloom_filter_methods,                /* tp_methods */
+    0, 0, 0, 0, 0, 0, 0,
+    (initproc) py_bloom_filter_init,        /* tp_init */
+    0,
+    PyType_GenericNew,                      /* tp_new */
+};
+
+/* HashIndex (path), the sidecar the hash_index option writes */
+typedef struct {
+    PyObject_HEAD
+    YumHashIndex *index;
+} PyHashIndex;
+
+static int
+py_hash_index_init (PyHashIndex *self, PyObject *args, PyObject *kwds)
+{
+    const char *path;
+    GError *err = NULL;
+
+    if (!PyArg_ParseTuple (args, "s:HashIndex", &path))
+        return -1;
+
+    if (self->index) {
+        yum_hash_index_free (self->index);
+        self->index = NULL;
+    }
+
+    self->index = yum_hash_index_open (path, &err);
+    if (err) {
+        PyErr_SetString (PyExc_IOError, err->message);
+        g_error_free (err);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+py_hash_index_dealloc (PyHashIndex *self)
+{
+    if (self->index)
+        yum_hash_index_free (self->index);
+    self->ob_type->tp_free ((PyObject *) self);
+}
+
+/* The list of pkgKeys of the name in args, empty if there are none */
+static PyObject *
+py_hash_index_lookup (PyHashIndex *self,
+                      PyObject *args,
+                      YumHashIndexTable table)
+{
+    const guint32 *pkgKeys;
+    PyObject *found;
+    PyObject *key;
+    const char *name;
+    int len;
+    guint32 n_pkgs = 0;
+    guint32 i;
+
+    if (!PyArg_ParseTuple (args, "s#", &name, &len))
+        return NULL;
+
+    if (!self->index) {
+        PyErr_SetString (PyExc_ValueError, "HashIndex is not open");
+        return NULL;
+    }
+
+    pkgKeys = yum_hash_index_lookup (self->index, table, name, len, &n_pkgs);
+    if (!pkgKeys)
+        n_pkgs = 0;
+
+    found = PyList_New (n_pkgs);
+    if (!found)
+        return NULL;
+
+    for (i = 0; i < n_pkgs; i++) {
+        key = PyInt_FromLong (pkgKeys[i]);
+        if (!key) {
+            Py_DECREF (found);
+            return NULL;
+        }
+        PyList_SET_ITEM (found, i, key);
+    }
+
+    return found;
+}
+
+static PyObject *
+py_hash_index_provides (PyHashIndex *self, PyObject *args)
+{
+    return py_hash_index_lookup (self, args, YUM_HASH_INDEX_PROVIDES);
+}
+
+static PyObject *
+py_hash_index_packages (PyHashIndex *self, PyObject *args)
+{
+    return py_hash_index_lookup (self, args, YUM_HASH_INDEX_PACKAGES);
+}
+
+static PyMethodDef py_hash_index_methods[] = {
+    {"provides", (PyCFunction) py_hash_index_provides, METH_VARARGS,
+     "pkgKeys of the packages providing name, in order."},
+    {"packages", (PyCFunction) py_hash_index_packages, METH_VARARGS,
+     "pkgKeys of the packages called name, in order."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject PyHashIndexType = {
+    PyObject_HEAD_INIT (NULL)
+    0,                                      /* ob_size */
+    "_sqlitecache.HashIndex",               /* tp_name */
+    sizeof (PyHashIndex),                   /* tp_basicsize */
+    0,                                      /* tp_itemsize */
+    (destructor) py_hash_index_dealloc,     /* tp_dealloc */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    Py_TPFLAGS_DEFAULT,                     /* tp_flags */
+    "Provides and package names of a primary cache to pkgKeys, mapped "
+    "from its .hidx sidecar.",              /* tp_doc */
+    0, 0, 0, 0, 0, 0,
+    py_hash_index_methods,                  /* tp_methods */
+    0, 0, 0, 0, 0, 0, 0,
+    (initproc) py_hash_index_init,          /* tp_init */
+    0,
+    PyType_GenericNew,                      /* tp_new */
+};
+
+/* Reader (path), packages of a cache as tuples, see yum_reader_open () */
+typedef struct {
+    PyObject_HEAD
+    YumReader *reader;
+    PyObject *columns;
+    gboolean filelists;         /* A filelists cache is attached */
+    gboolean other;             /* An other cache is attached */
+} PyReader;
+
+static PyObject *
+column_to_py (sqlite3_stmt *handle, int i)
+{
+    sqlite3_int64 n;
+    PyObject *buffer;
+    void *data;
+    Py_ssize_t len;
+
+    switch (sqlite3_column_type (handle, i)) {
+    case SQLITE_INTEGER:
+        n = sqlite3_column_int64 (handle, i);
+        if (n >= LONG_MIN && n <= LONG_MAX)
+            return PyInt_FromLong ((long) n);
+        return PyLong_FromLongLong (n);
+    case SQLITE_FLOAT:
+        return PyFloat_FromDouble (sqlite3_column_double (handle, i));
+    case SQLITE_TEXT:
+        return PyString_FromStringAndSize
+            ((const char *) sqlite3_column_text (handle, i),
+             sqlite3_column_bytes (handle, i));
+    case SQLITE_BLOB:
+        /* A buffer, like the sqlite3 module hands out */
+        len = sqlite3_column_bytes (handle, i);
+        buffer = PyBuffer_New (len);
+        if (buffer && PyObject_AsWriteBuffer (buffer, &data, &len) == 0)
+            memcpy (data, sqlite3_column_blob (handle, i), len);
+        return buffer;
+    default:
+        Py_INCREF (Py_None);
+        return Py_None;
+    }
+}
+
+static PyObject *
+row_to_tuple (sqlite3_stmt *handle)
+{
+    PyObject *row;
+    PyObject *value;
+    int n;
+    int i;
+
+    n = sqlite3_column_count (handle);
+    row = PyTuple_New (n);
+    for (i = 0; row && i < n; i++) {
+        value = column_to_py (handle, i);
+        if (!value) {
+            Py_DECREF (row);
+            return NULL;
+        }
+        PyTuple_SET_ITEM (row, i, value);
+    }
+
+    return row;
+}
+
+/* Steps handle through its rows, appending a tuple of each to rows */
+static gboolean
+reader_fetch (PyReader *self, sqlite3_stmt *handle, PyObject *rows)
+{
+    PyObject *row;
+    int rc;
+
+    while ((rc = sqlite3_step (handle)) == SQLITE_ROW) {
+        row = row_to_tuple (handle);
+        if (!row || PyList_Append (rows, row) < 0) {
+            Py_XDECREF (row);
+            sqlite3_reset (handle);
+            return FALSE;
+        }
+        Py_DECREF (row);
+    }
+    sqlite3_reset (handle);
+
+    if (rc != SQLITE_DONE) {
+        PyErr_Format (PyExc_TypeError, "Can not read packages: %s",
+                      sqlite3_errmsg (yum_reader_db (self->reader)));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static sqlite3_stmt *
+reader_statement (PyReader *self, const char *sql)
+{
+    sqlite3_stmt *handle;
+    GError *err = NULL;
+
+    if (!self->reader) {
+        PyErr_SetString (PyExc_ValueError, "Reader is closed");
+        return NULL;
+    }
+
+    handle = yum_reader_statement (self->reader, sql, &err);
+    if (err) {
+        PyErr_SetString (PyExc_TypeError, err->message);
+        g_error_free (err);
+    }
+
+    return handle;
+}
+
+static int
+py_reader_init (PyReader *self, PyObject *args, PyObject *kwds)
+{
+    sqlite3_stmt *handle;
+    const char *path;
+    GError *err = NULL;
+    int n;
+    int i;
+
+    if (!PyArg_ParseTuple (args, "s:Reader", &path))
+        return -1;
+
+    if (self->reader) {
+        yum_reader_close (self->reader);
+        self->reader = NULL;
+    }
+    Py_CLEAR (self->columns);
+    self->filelists = FALSE;
+    self->other = FALSE;
+
+    self->reader = yum_reader_open (path, &err);
+    if (err) {
+        PyErr_SetString (PyExc_IOError, err->message);
+        g_error_free (err);
+        return -1;
+    }
+
+    handle = reader_statement (self, "SELECT * FROM packages");
+    if (!handle)
+        return -1;
+
+    n = sqlite3_column_count (handle);
+    self->columns = PyTuple_New (n);
+    for (i = 0; self->columns && i < n; i++) {
+        PyObject *name = PyString_FromString (sqlite3_column_name (handle,
+                                                                   i));
+        if (!name) {
+            Py_CLEAR (self->columns);
+            break;
+        }
+        PyTuple_SET_ITEM (self->columns, i, name);
+    }
+
+    return self->columns ? 0 : -1;
+}
+
+static void
+py_reader_dealloc (PyReader *self)
+{
+    if (self->reader)
+        yum_reader_close (self->reader);
+    Py_XDECREF (self->columns);
+    self->ob_type->tp_free ((PyObject *) self);
+}
+
+static PyObject *
+py_reader_query (PyReader *self, const char *sql, const char *text)
+{
+    sqlite3_stmt *handle;
+    PyObject *rows;
+
+    handle = reader_statement (self, sql);
+    if (!handle)
+        return NULL;
+
+    if (text)
+        sqlite3_bind_text (handle, 1, text, -1, SQLITE_TRANSIENT);
+
+    rows = PyList_New (0);
+    if (rows && !reader_fetch (self, handle, rows)) {
+        Py_DECREF (rows);
+        rows = NULL;
+    }
+
+    return rows;
+}
+
+static PyObject *
+py_reader_packages (PyReader *self, PyObject *args)
+{
+    return py_reader_query (self, "SELECT * FROM packages", NULL);
+}
+
+static PyObject *
+py_reader_packages_by_name (PyReader *self, PyObject *args)
+{
+    const char *name;
+
+    if (!PyArg_ParseTuple (args, "s:packages_by_name", &name))
+        return NULL;
+
+    return py_reader_query (self, "SELECT * FROM packages WHERE name = ?",
+                            name);
+}
+
+static PyObject *
+py_reader_packages_providing (PyReader *self, PyObject *args)
+{
+    const char *name;
+
+    if (!PyArg_ParseTuple (args, "s:packages_providing", &name))
+        return NULL;
+
+    return py_reader_query (self, "SELECT * FROM packages WHERE pkgKey IN"
+                            "  (SELECT pkgKey FROM provides WHERE name = ?)",
+                            name);
+}
+
+static PyObject *
+py_reader_packages_by_keys (PyReader *self, PyObject *args)
+{
+    sqlite3_stmt *handle;
+    PyObject *seq;
+    PyObject *fast;
+    PyObject *rows;
+    PY_LONG_LONG pkgKey;
+    Py_ssize_t i;
+
+    if (!PyArg_ParseTuple (args, "O:packages_by_keys", &seq))
+        return NULL;
+
+    handle = reader_statement (self, "SELECT * FROM packages"
+                               "  WHERE pkgKey = ?");
+    if (!handle)
+        return NULL;
+
+    fast = PySequence_Fast (seq, "pkgKeys must be a sequence");
+    if (!fast)
+        return NULL;
+
+    rows = PyList_New (0);
+    for (i = 0; rows && i < PySequence_Fast_GET_SIZE (fast); i++) {
+        pkgKey = PyLong_AsLongLong (PySequence_Fast_GET_ITEM (fast, i));
+        if (pkgKey == -1 && PyErr_Occurred ()) {
+            Py_CLEAR (rows);
+            break;
+        }
+
+        sqlite3_bind_int64 (handle, 1, pkgKey);
+        if (!reader_fetch (self, handle, rows))
+            Py_CLEAR (rows);
+    }
+    Py_DECREF (fast);
+
+    return rows;
+}
+
+static void
+reader_lookup_cb (guint dep, gint64 pkgKey, gpointer user_data)
+{
+    PyObject *found = (PyObject *) user_data;
+    PyObject *key;
+
+    if (PyErr_Occurred ())
+        return;
+
+    key = PyLong_FromLongLong (pkgKey);
+    if (key) {
+        PyList_Append (PyList_GET_ITEM (found, dep), key);
+        Py_DECREF (key);
+    }
+}
+
+/*  The pkgKeys of the packages with a row in table matching each of a
+ * sequence of dependencies, names or (name, flags, (epoch, version,
+ * release)) tuples, as a dict keyed by them. */
+static PyObject *
+py_reader_lookup (PyReader *self, PyObject *args, const char *table)
+{
+    PyObject *seq;
+    PyObject *fast;
+    PyObject *found = NULL;
+    PyObject *result = NULL;
+    Dependency *deps;
+    Py_ssize_t n, i;
+    GError *err = NULL;
+
+    if (!PyArg_ParseTuple (args, "O", &seq))
+        return NULL;
+    if (!self->reader) {
+        PyErr_SetString (PyExc_ValueError, "Reader is closed");
+        return NULL;
+    }
+
+    fast = PySequence_Fast (seq, "dependencies must be a sequence");
+    if (!fast)
+        return NULL;
+
+    n = PySequence_Fast_GET_SIZE (fast);
+    deps = g_new0 (Dependency, n);
+    for (i = 0; i < n; i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM (fast, i);
+
+        if (PyString_Check (item))
+            deps[i].name = PyString_AS_STRING (item);
+        else if (!PyTuple_Check (item)) {
+            PyErr_SetString (PyExc_TypeError,
+                             "dependencies must be strings or tuples");
+            goto cleanup;
+        } else if (!PyArg_ParseTuple (item, "sz(zzz)", &deps[i].name,
+                                      &deps[i].flags, &deps[i].epoch,
+                                      &deps[i].version, &deps[i].release))
+            goto cleanup;
+    }
+
+    found = PyList_New (n);
+    for (i = 0; found && i < n; i++) {
+        PyObject *keys = PyList_New (0);
+
+        if (!keys)
+            goto cleanup;
+        PyList_SET_ITEM (found, i, keys);
+    }
+    if (!found)
+        goto cleanup;
+
+    yum_reader_lookup_deps (self->reader, table, deps, n,
+                            reader_lookup_cb, found, &err);
+    if (err) {
+        PyErr_SetString (PyExc_TypeError, err->message);
+        g_error_free (err);
+        goto cleanup;
+    }
+    if (PyErr_Occurred ())
+        goto cleanup;
+
+    result = PyDict_New ();
+    for (i = 0; result && i < n; i++) {
+        if (PyDict_SetItem (result, PySequence_Fast_GET_ITEM (fast, i),
+                            PyList_GET_ITEM (found, i)) < 0)
+            Py_CLEAR (result);
+    }
+
+ cleanup:
+    Py_XDECREF (found);
+    g_free (deps);
+    Py_DECREF (fast);
+
+    return result;
+}
+
+static PyObject *
+py_reader_whatprovides (PyReader *self, PyObject *args)
+{
+    return py_reader_lookup (self, args, "provides");
+}
+
+static PyObject *
+py_reader_whatrequires (PyReader *self, PyObject *args)
+{
+    return py_reader_lookup (self, args, "requires");
+}
+
+static PyObject *
+py_reader_close (PyReader *self, PyObject *args)
+{
+    if (self->reader) {
+        yum_reader_close (self->reader);
+        self->reader = NULL;
+    }
+
+    Py_INCREF (Py_None);
+    return Py_None;
+}
+
+static PyObject *
+py_reader_attach (PyReader *self, PyObject *args)
+{
+    const char *schema;
+    const char *path;
+    GError *err = NULL;
+
+    if (!PyArg_ParseTuple (args, "ss:attach", &schema, &path))
+        return NULL;
+    if (!self->reader) {
+        PyErr_SetString (PyExc_ValueError, "Reader is closed");
+        return NULL;
+    }
+    if (strcmp (schema, "filelists") && strcmp (schema, "other")) {
+        PyErr_Format (PyExc_ValueError, "Can not attach a %s cache", schema);
+        return NULL;
+    }
+
+    if (!yum_reader_attach (self->reader, path, schema, &err)) {
+        PyErr_SetString (PyExc_IOError, err->message);
+        g_error_free (err);
+        return NULL;
+    }
+
+    if (!strcmp (schema, "filelists"))
+        self->filelists = TRUE;
+    else
+        self->other = TRUE;
+
+    Py_INCREF (Py_None);
+    return Py_None;
+}
+
+/*  Package, a package of a Reader holding only its key and NEVRA. The
+ * rest is read from the caches on first use and kept. */
+typedef struct {
+    PyObject_HEAD
+    PyReader *reader;
+    PY_LONG_LONG pkgKey;
+    PyObject *pkgId;
+    PyObject *name;
+    PyObject *arch;
+    PyObject *epoch;
+    PyObject *version;
+    PyObject *release;
+    PyObject *fetched;          /* Attribute name to value, or NULL */
+} PyPackage;
+
+static void
+py_package_dealloc (PyPackage *self)
+{
+    Py_XDECREF (self->reader);
+    Py_XDECREF (self->pkgId);
+    Py_XDECREF (self->name);
+    Py_XDECREF (self->arch);
+    Py_XDECREF (self->epoch);
+    Py_XDECREF (self->version);
+    Py_XDECREF (self->release);
+    Py_XDECREF (self->fetched);
+    PyObject_Del (self);
+}
+
+static PyObject *
+package_error (PyPackage *self, const char *what)
+{
+    PyErr_Format (PyExc_TypeError, "Can not read %s: %s", what,
+                  sqlite3_errmsg (yum_reader_db (self->reader->reader)));
+    return NULL;
+}
+
+/* Keeps every column of the package's packages row in fetched */
+static gboolean
+package_fetch_row (PyPackage *self)
+{
+    sqlite3_stmt *handle;
+    PyObject *value;
+    int rc;
+    int i;
+
+    handle = reader_statement (self->reader,
+                               "SELECT * FROM packages WHERE pkgKey = ?");
+    if (!handle)
+        return FALSE;
+
+    sqlite3_bind_int64 (handle, 1, self->pkgKey);
+    rc = sqlite3_step (handle);
+    for (i = 0; rc == SQLITE_ROW && i < sqlite3_column_count (handle); i++) {
+        value = column_to_py (handle, i);
+        if (!value ||
+            PyDict_SetItem (self->fetched,
+                            PyTuple_GET_ITEM (self->reader->columns, i),
+                            value) < 0) {
+            Py_XDECREF (value);
+            sqlite3_reset (handle);
+            return FALSE;
+        }
+        Py_DECREF (value);
+    }
+    sqlite3_reset (handle);
+
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        package_error (self, "package");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Appends path to the list of files of type, a filelist filetypes letter */
+static gboolean
+files_append (PyObject *files, char type, const char *path, Py_ssize_t len)
+{
+    PyObject *value;
+    int rc;
+
+    value = PyString_FromStringAndSize (path, len);
+    if (!value)
+        return FALSE;
+
+    rc = PyList_Append (PyDict_GetItemString (files, type == 'd' ? "dir" :
+                                              type == 'g' ? "ghost" :
+                                              "file"), value);
+    Py_DECREF (value);
+
+    return rc == 0;
+}
+
+/* Appends the paths of a filelist row to files */
+static gboolean
+files_append_row (PyObject *files, sqlite3_stmt *handle, GString *path)
+{
+    YumFilenamesIter iter;
+    const char *name;
+    const char *types;
+    gsize name_len;
+    gsize dir_len;
+
+    yum_filenames_iter_init (&iter,
+                             (const char *) sqlite3_column_text (handle, 1),
+                             sqlite3_column_bytes (handle, 1));
+    types = (const char *) sqlite3_column_text (handle, 2);
+
+    g_string_assign (path, (const char *) sqlite3_column_text (handle, 0));
+    if (path->len && path->str[path->len - 1] != '/')
+        g_string_append_c (path, '/');
+    dir_len = path->len;
+
+    while (yum_filenames_iter_next (&iter, &name, &name_len)) {
+        g_string_append_len (path, name, name_len);
+        if (!files_append (files, types && *types ? *types++ : 'f',
+                           path->str, path->len))
+            return FALSE;
+        g_string_truncate (path, dir_len);
+    }
+
+    return TRUE;
+}
+
+/*  The files of the package by type, as yum's package objects have them:
+ * all of them with a filelists cache attached, else the ones in
+ * primary. */
+static PyObject *
+package_files (PyPackage *self)
+{
+    static const char *types[] = { "file", "dir", "ghost", NULL };
+    sqlite3_stmt *handle;
+    PyObject *files;
+    PyObject *list;
+    GError *err = NULL;
+    gint64 pkgKey = self->pkgKey;
+    const char *pkgId;
+    GString *path;
+    gboolean ok = TRUE;
+    int rc;
+    int i;
+
+    if (self->reader->filelists) {
+        handle = reader_statement (self->reader,
+                                   "SELECT dirname, filenames, filetypes"
+                                   "  FROM filelists.filelist"
+                                   "  WHERE pkgKey = ?");
+        if (!handle)
+            return NULL;
+
+        pkgId = PyString_AsString (self->pkgId);
+        if (!pkgId)
+            return NULL;
+
+        pkgKey = yum_reader_attached_key (self->reader->reader, "filelists",
+                                          pkgId, &err);
+        if (err) {
+            PyErr_SetString (PyExc_TypeError, err->message);
+            g_error_free (err);
+            return NULL;
+        }
+    } else {
+        handle = reader_statement (self->reader,
+                                   "SELECT name, type FROM files"
+                                   "  WHERE pkgKey = ?");
+        if (!handle)
+            return NULL;
+    }
+
+    files = PyDict_New ();
+    for (i = 0; files && types[i]; i++) {
+        list = PyList_New (0);
+        if (!list || PyDict_SetItemString (files, types[i], list) < 0)
+            Py_CLEAR (files);
+        Py_XDECREF (list);
+    }
+    if (!files)
+        return NULL;
+
+    sqlite3_bind_int64 (handle, 1, pkgKey);
+    path = g_string_sized_new (256);
+    while (ok && (rc = sqlite3_step (handle)) == SQLITE_ROW) {
+        const char *type;
+
+        if (self->reader->filelists) {
+            ok = files_append_row (files, handle, path);
+            continue;
+        }
+
+        type = (const char *) sqlite3_column_text (handle, 1);
+        ok = files_append (files, type ? *type : 'f',
+                           (const char *) sqlite3_column_text (handle, 0),
+                           sqlite3_column_bytes (handle, 0));
+    }
+    sqlite3_reset (handle);
+    g_string_free (path, TRUE);
+
+    if (ok && rc != SQLITE_DONE) {
+        package_error (self, "files");
+        ok = FALSE;
+    }
+    if (!ok)
+        Py_CLEAR (files);
+
+    return files;
+}
+
+/* The package's rows of a dependency table as (name, flags, (e, v, r)) */
+static PyObject *
+package_deps (PyPackage *self, const char *table)
+{
+    sqlite3_stmt *handle;
+    PyObject *deps;
+    PyObject *dep;
+    char *sql;
+    int rc;
+
+    sql = g_strdup_printf ("SELECT name, flags, epoch, version, release"
+                           "  FROM %s WHERE pkgKey = ?", table);
+    handle = reader_statement (self->reader, sql);
+    g_free (sql);
+    if (!handle)
+        return NULL;
+
+    deps = PyList_New (0);
+    if (!deps)
+        return NULL;
+
+    sqlite3_bind_int64 (handle, 1, self->pkgKey);
+    while ((rc = sqlite3_step (handle)) == SQLITE_ROW) {
+        dep = Py_BuildValue ("(zz(zzz))",
+                             sqlite3_column_text (handle, 0),
+                             sqlite3_column_text (handle, 1),
+                             sqlite3_column_text (handle, 2),
+                             sqlite3_column_text (handle, 3),
+                             sqlite3_column_text (handle, 4));
+        if (!dep || PyList_Append (deps, dep) < 0) {
+            Py_XDECREF (dep);
+            break;
+        }
+        Py_DECREF (dep);
+    }
+    sqlite3_reset (handle);
+
+    if (!PyErr_Occurred () && rc != SQLITE_DONE)
+        package_error (self, table);
+    if (PyErr_Occurred ())
+        Py_CLEAR (deps);
+
+    return deps;
+}
+
+/*  The package's changelog in the attached other cache as (date, author,
+ * changelog) tuples, newest first like yum orders them. */
+static PyObject *
+package_changelog (PyPackage *self)
+{
+    sqlite3_stmt *handle;
+    PyObject *changelog;
+    GError *err = NULL;
+    const char *pkgId;
+    gint64 pkgKey;
+
+    if (!self->reader->other) {
+        PyErr_SetString (PyExc_ValueError, "No other cache attached");
+        return NULL;
+    }
+
+    handle = reader_statement (self->reader,
+                               "SELECT date, author, changelog"
+                               "  FROM other.changelog WHERE pkgKey = ?"
+                               "  ORDER BY date DESC");
+    if (!handle)
+        return NULL;
+
+    pkgId = PyString_AsString (self->pkgId);
+    if (!pkgId)
+        return NULL;
+
+    pkgKey = yum_reader_attached_key (self->reader->reader, "other", pkgId,
+                                      &err);
+    if (err) {
+        PyErr_SetString (PyExc_TypeError, err->message);
+        g_error_free (err);
+        return NULL;
+    }
+
+    changelog = PyList_New (0);
+    if (!changelog)
+        return NULL;
+
+    sqlite3_bind_int64 (handle, 1, pkgKey);
+    if (!reader_fetch (self->reader, handle, changelog))
+        Py_CLEAR (changelog);
+
+    return changelog;
+}
+
+/*  Attributes that are not members are read on first use and kept in
+ * fetched: files, the dependency lists, changelog and the columns of the
+ * packages row, which are all read together. */
+static PyObject *
+py_package_getattro (PyPackage *self, PyObject *name)
+{
+    PyObject *value;
+    const char *attr;
+    gboolean column;
+
+    value = PyObject_GenericGetAttr ((PyObject *) self, name);
+    if (value || !PyErr_ExceptionMatches (PyExc_AttributeError) ||
+        !PyString_Check (name))
+        return value;
+
+    if (self->fetched) {
+        value = PyDict_GetItem (self->fetched, name);
+        if (value) {
+            PyErr_Clear ();
+            Py_INCREF (value);
+            return value;
+        }
+    }
+
+    attr = PyString_AS_STRING (name);
+    column = PySequence_Contains (self->reader->columns, name) == 1;
+    if (!column && strcmp (attr, "files") && strcmp (attr, "changelog") &&
+        strcmp (attr, "provides") && strcmp (attr, "requires") &&
+        strcmp (attr, "conflicts") && strcmp (attr, "obsoletes"))
+        return NULL;
+
+    PyErr_Clear ();
+    if (!self->fetched) {
+        self->fetched = PyDict_New ();
+        if (!self->fetched)
+            return NULL;
+    }
+
+    if (column) {
+        if (!package_fetch_row (self))
+            return NULL;
+        value = PyDict_GetItem (self->fetched, name);
+        if (!value)
+            PyErr_SetObject (PyExc_AttributeError, name);
+        Py_XINCREF (value);
+        return value;
+    }
+
+    if (!strcmp (attr, "files"))
+        value = package_files (self);
+    else if (!strcmp (attr, "changelog"))
+        value = package_changelog (self);
+    else
+        value = package_deps (self, attr);
+
+    if (value && PyDict_SetItem (self->fetched, name, value) < 0)
+        Py_CLEAR (value);
+
+    return value;
+}
+
+static PyMemberDef py_package_members[] = {
+    {"pkgKey", T_LONGLONG, offsetof (PyPackage, pkgKey), READONLY,
+     "The key of the package in its primary cache."},
+    {"pkgId", T_OBJECT, offsetof (PyPackage, pkgId), READONLY, NULL},
+    {"name", T_OBJECT, offsetof (PyPackage, name), READONLY, NULL},
+    {"arch", T_OBJECT, offsetof (PyPackage, arch), READONLY, NULL},
+    {"epoch", T_OBJECT, offsetof (PyPackage, epoch), READONLY, NULL},
+    {"version", T_OBJECT, offsetof (PyPackage, version), READONLY, NULL},
+    {"release", T_OBJECT, offsetof (PyPackage, release), READONLY, NULL},
+    {NULL, 0, 0, 0, NULL}
+};
+
+static PyTypeObject PyPackageType = {
+    PyObject_HEAD_INIT (NULL)
+    0,                                      /* ob_size */
+    "_sqlitecache.Package",                 /* tp_name */
+    sizeof (PyPackage),                     /* tp_basicsize */
+    0,                                      /* tp_itemsize */
+    (destructor) py_package_dealloc,        /* tp_dealloc */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    (getattrofunc) py_package_getattro,     /* tp_getattro */
+    0, 0,
+    Py_TPFLAGS_DEFAULT,                     /* tp_flags */
+    "A package of a Reader. The columns of its packages row, files, "
+    "provides, requires, conflicts, obsoletes and changelog are read "
+    "on first use.",                        /* tp_doc */
+    0, 0, 0, 0, 0, 0, 0,
+    py_package_members,                     /* tp_members */
+};
+
+static PyObject *
+py_reader_lazy_packages (PyReader *self, PyObject *args)
+{
+    sqlite3_stmt *handle;
+    PyPackage *package;
+    PyObject *packages;
+    int rc;
+
+    handle = reader_statement (self, "SELECT pkgKey, pkgId, name, arch,"
+                               "  epoch, version, release FROM packages");
+    if (!handle)
+        return NULL;
+
+    packages = PyList_New (0);
+    if (!packages)
+        return NULL;
+
+    while ((rc = sqlite3_step (handle)) == SQLITE_ROW) {
+        package = PyObject_New (PyPackage, &PyPackageType);
+        if (!package)
+            break;
+
+        Py_INCREF (self);
+        package->reader = self;
+        package->pkgKey = sqlite3_column_int64 (handle, 0);
+        package->pkgId = column_to_py (handle, 1);
+        package->name = column_to_py (handle, 2);
+        package->arch = column_to_py (handle, 3);
+        package->epoch = column_to_py (handle, 4);
+        package->version = column_to_py (handle, 5);
+        package->release = column_to_py (handle, 6);
+        package->fetched = NULL;
+
+        /* A handful of values most packages share */
+        if (package->arch && PyString_CheckExact (package->arch))
+            PyString_InternInPlace (&package->arch);
+        if (package->epoch && PyString_CheckExact (package->epoch))
+            PyString_InternInPlace (&package->epoch);
+
+        if (!package->pkgId || !package->name || !package->arch ||
+            !package->epoch || !package->version || !package->release ||
+            PyList_Append (packages, (PyObject *) package) < 0) {
+            Py_DECREF (package);
+            break;
+        }
+        Py_DECREF (package);
+    }
+    sqlite3_reset (handle);
+
+    if (!PyErr_Occurred () && rc != SQLITE_DONE)
+        PyErr_Format (PyExc_TypeError, "Can not read packages: %s",
+                      sqlite3_errmsg (yum_reader_db (self->reader)));
+    if (PyErr_Occurred ())
+        Py_CLEAR (packages);
+
+    return packages;
+}
+
+static PyMethodDef py_reader_methods[] = {
+    {"packages", (PyCFunction) py_reader_packages, METH_NOARGS,
+     "All packages, a tuple of columns each."},
+    {"packages_by_name", (PyCFunction) py_reader_packages_by_name,
+     METH_VARARGS, "The packages called name."},
+    {"packages_by_keys", (PyCFunction) py_reader_packages_by_keys,
+     METH_VARARGS, "The packages of a sequence of pkgKeys, in its order."},
+    {"packages_providing", (PyCFunction) py_reader_packages_providing,
+     METH_VARARGS, "The packages with a provide called name."},
+    {"whatprovides", (PyCFunction) py_reader_whatprovides, METH_VARARGS,
+     "A dict of the pkgKeys of the packages providing each of a sequence of\n"
+     "names or (name, flags, (epoch, version, release)) tuples."},
+    {"whatrequires", (PyCFunction) py_reader_whatrequires, METH_VARARGS,
+     "A dict of the pkgKeys of the packages requiring each of a sequence of\n"
+     "names or (name, flags, (epoch, version, release)) tuples."},
+    {"lazy_packages", (PyCFunction) py_reader_lazy_packages, METH_NOARGS,
+     "All packages, as Package objects reading the rest of a package on\n"
+     "first use."},
+    {"attach", (PyCFunction) py_reader_attach, METH_VARARGS,
+     "Attach the 'filelists' or 'other' cache at a path, for the files and\n"
+     "changelog of Package objects."},
+    {"close", (PyCFunction) py_reader_close, METH_NOARGS,
+     "Close the cache."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyMemberDef py_reader_members[] = {
+    {"columns", T_OBJECT, offsetof (PyReader, columns), READONLY,
+     "The names of the package columns, in tuple order."},
+    {NULL, 0, 0, 0, NULL}
+};
+
+static PyTypeObject PyReaderType = {
+    PyObject_HEAD_INIT (NULL)
+    0,                                      /* ob_size */
+    "_sqlitecache.Reader",                  /* tp_name */
+    sizeof (PyReader),                      /* tp_basicsize */
+    0,                                      /* tp_itemsize */
+    (destructor) py_reader_dealloc,         /* tp_dealloc */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    Py_TPFLAGS_DEFAULT,                     /* tp_flags */
+    "Read-only, memory mapped access to the packages of a cache, "
+    "returned as tuples.",                  /* tp_doc */
+    0, 0, 0, 0, 0, 0,
+    py_reader_methods,                      /* tp_methods */
+    py_reader_members,                      /* tp_members */
+    0, 0, 0, 0, 0, 0,
+    (initproc) py_reader_init,              /* tp_init */
+    0,
+    PyType_GenericNew,                      /* tp_new */
+};
+
+static PyMethodDef SqliteMethods[] = {
+    {"update_primary", py_update_primary, METH_VARARGS,
+     "Parse YUM primary.xml metadata."},
+    {"update_filelist", py_update_filelist, METH_VARARGS,
+     "Parse YUM filelists.xml metadata."},
+    {"update_other", py_update_other, METH_VARARGS,
+     "Parse YUM other.xml metadata."},
+    {"decode_filenames", py_decode_filenames, METH_VARARGS,
+     "Decode filelist filenames stored by the front_code_files option."},
+    {"evr_key", py_evr_key, METH_VARARGS,
+     "The sort key of an epoch, version and release, see evr_columns."},
+    {"rpmvercmp", py_rpmvercmp, METH_VARARGS,
+     "Compare two versions like rpm does."},
+    {"evr_cmp", py_evr_cmp, METH_VARARGS,
+     "Compare two epoch, version, release triples like rpm does."},
+    {"filelist_contains", py_filelist_contains, METH_VARARGS,
+     "Whether a path is one of the files of a filelist row."},
+    {"lookup_paths", py_lookup_paths, METH_VARARGS,
+     "Find the packages owning paths in a filelists cache built with "
+     "path_index."},
+    {"search_packages", py_search_packages, METH_VARARGS,
+     "Search the summaries and descriptions of a primary cache."},
+    {"resolve_requires", py_resolve_requires, METH_VARARGS,
+     "Find the providers of the requires of packages in primary caches."},
+
+    {NULL, NULL, 0, NULL}
+};
+
+PyMODINIT_FUNC
+init_sqlitecache (void)
+{
+    PyObject * m, * d;
+
+    if (PyType_Ready (&PyBloomFilterType) < 0)
+        return;
+    if (PyType_Ready (&PyHashIndexType) < 0)
+        return;
+    if (PyType_Ready (&PyReaderType) < 0)
+        return;
+    if (PyType_Ready (&PyPackageType) < 0)
+        return;
+
+    m = Py_InitModule ("_sqlitecache", SqliteMethods);
+
+    Py_INCREF (&PyBloomFilterType);
+    PyModule_AddObject (m, "BloomFilter", (PyObject *) &PyBloomFilterType);
+    Py_INCREF (&PyHashIndexType);
+    PyModule_AddObject (m, "HashIndex", (PyObject *) &PyHashIndexType);
+    Py_INCREF (&PyReaderType);
+    PyModule_AddObject (m, "Reader", (PyObject *) &PyReaderType);
+    Py_INCREF (&PyPackageType);
+    PyModule_AddObject (m, "Package", (PyObject *) &PyPackageType);
 
     d = PyModule_GetDict(m);
     PyDict_SetItemString(d, "DBVERSION", PyInt_FromLong(YUM_SQLITE_CACHE_DBVERSION));
@@ -16,20 +16,58 @@ try:
     import sqlite3 as sqlite
 except ImportError:
     import sqlite
+import os
 import _sqlitecache
 
+# ymp_sqlite.so, the SQL functions of _sqlitecache as an SQLite extension
+_extension = os.path.join(os.path.dirname(_sqlitecache.__file__),
+                          'ymp_sqlite.so')
+
 DBVERSION = _sqlitecache.DBVERSION
 
 class RepodataParserSqlite:
-    def __init__(self, storedir, repoid, callback=None):
+    def __init__(self, storedir, repoid, callback=None, options=None):
+        """options is an optional dict of build settings passed on to
+           _sqlitecache, see the README."""
         self.callback = callback
         self.repoid = repoid
+        self.options = options
 
     def open_database(self, filename):
+        """An sqlite connection to the cache, with the SQL functions
+           rpmvercmp(a, b), evr_cmp(e1, v1, r1, e2, v2, r2) and
+           filelist_contains(dirname, filenames, path), and where the
+           sqlite module can load extensions the filelist_expand(dirname,
+           filenames[, filetypes]) table-valued function with a (path,
+           type) row per file."""
         if not filename:
             return None
         con = sqlite.connect(filename)
         con.text_factory = str
+        if hasattr(con, 'create_function'):
+            con.create_function("ymp_filenames", 1,
+                                _sqlitecache.decode_filenames)
+            con.create_function("ymp_evr_key", 3, _sqlitecache.evr_key)
+            con.create_function("rpmvercmp", 2, _sqlitecache.rpmvercmp)
+            con.create_function("evr_cmp", 6, _sqlitecache.evr_cmp)
+            con.create_function("filelist_contains", 3,
+                                _sqlitecache.filelist_contains)
+        # The same functions in C, replacing the ones above, and the
+        # filelist_expand() table-valued function, where the sqlite module
+        # can load extensions. Without ymp_sqlite.so, e.g. run from the
+        # source tree, the ones above do and only filelist_expand() is
+        # missing.
+        if hasattr(con, 'enable_load_extension'):
+            try:
+                con.enable_load_extension(True)
+                try:
+                    con.load_extension(_extension)
+                finally:
+                    con.enable_load_extension(False)
+            except sqlite.OperationalError, e:
+                if hasattr(self.callback, 'log'):
+                    self.callback.log(1, "Can not load the SQLite "
+                                         "extension: %s" % e)
         if sqlite.version_info[0] > 1:
             con.row_factory = sqlite.Row
         cur = con.cursor()
@@ -37,13 +75,28 @@ class RepodataParserSqlite:
         del cur
         return con
 
+    def open_reader(self, filename, filelists=None, other=None):
+        """A _sqlitecache.Reader of the cache, which hands out packages as
+           plain tuples, see its columns attribute for their order, or as
+           lazy Package objects.  The filelists and other caches, when
+           given, are attached for the files and changelogs of those."""
+        if not filename:
+            return None
+        reader = _sqlitecache.Reader(filename)
+        if filelists:
+            reader.attach('filelists', filelists)
+        if other:
+            reader.attach('other', other)
+        return reader
+
     def getPrimary(self, location, checksum):
         """Load primary.xml.gz from an sqlite cache and update it 
            if required"""
         return self.open_database(_sqlitecache.update_primary(location,
 															  checksum,
                                                               self.callback,
-                                                              self.repoid))
+                                                              self.repoid,
+                                                              self.options))
 
     def getFilelists(self, location, checksum):
         """Load filelist.xml.gz from an sqlite cache and update it if 
@@ -51,12 +104,14 @@ class RepodataParserSqlite:
         return self.open_database(_sqlitecache.update_filelist(location,
 															   checksum,
                                                                self.callback,
-                                                               self.repoid))
+                                                               self.repoid,
+                                                               self.options))
 
     def getOtherdata(self, location, checksum):
         """Load other.xml.gz from an sqlite cache and update it if required"""
         return self.open_database(_sqlitecache.update_other(location,
 															checksum,
                                                             self.callback,
-                                                            self.repoid))
+                                                            self.repoid,
+                                                            self.options))
     
@@ -0,0 +1,236 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/*  Checks yum_rpmvercmp (), yum_evr_cmp () and the order of
+ * yum_evr_sort_key () against what rpm answers for the same labels. The
+ * version pairs are those of rpm's own rpmvercmp tests. Build and run
+ * from the top directory with
+ *
+ *   gcc -I. -o evr-test tests/evr-test.c evr.c \
+ *       `pkg-config --cflags --libs glib-2.0` && ./evr-test
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "evr.h"
+
+typedef struct {
+    const char *a;
+    const char *b;
+    int result;
+} VersionCase;
+
+static const VersionCase versions[] = {
+    { "1.0", "1.0", 0 },
+    { "1.0", "2.0", -1 },
+    { "2.0", "1.0", 1 },
+    { "2.0.1", "2.0.1", 0 },
+    { "2.0", "2.0.1", -1 },
+    { "2.0.1", "2.0", 1 },
+    { "2.0.1a", "2.0.1a", 0 },
+    { "2.0.1a", "2.0.1", 1 },
+    { "2.0.1", "2.0.1a", -1 },
+    { "5.5p1", "5.5p1", 0 },
+    { "5.5p1", "5.5p2", -1 },
+    { "5.5p2", "5.5p1", 1 },
+    { "5.5p10", "5.5p10", 0 },
+    { "5.5p1", "5.5p10", -1 },
+    { "5.5p10", "5.5p1", 1 },
+    { "10xyz", "10.1xyz", -1 },
+    { "10.1xyz", "10xyz", 1 },
+    { "xyz10", "xyz10", 0 },
+    { "xyz10", "xyz10.1", -1 },
+    { "xyz10.1", "xyz10", 1 },
+    { "xyz.4", "xyz.4", 0 },
+    { "xyz.4", "8", -1 },
+    { "8", "xyz.4", 1 },
+    { "xyz.4", "2", -1 },
+    { "2", "xyz.4", 1 },
+    { "5.5p2", "5.6p1", -1 },
+    { "5.6p1", "5.5p2", 1 },
+    { "5.6p1", "6.5p1", -1 },
+    { "6.5p1", "5.6p1", 1 },
+    { "6.0.rc1", "6.0", 1 },
+    { "6.0", "6.0.rc1", -1 },
+    { "10b2", "10a1", 1 },
+    { "10a2", "10b2", -1 },
+    { "1.0aa", "1.0aa", 0 },
+    { "1.0a", "1.0aa", -1 },
+    { "1.0aa", "1.0a", 1 },
+    { "10.0001", "10.0001", 0 },
+    { "10.0001", "10.1", 0 },
+    { "10.1", "10.0001", 0 },
+    { "10.0001", "10.0039", -1 },
+    { "10.0039", "10.0001", 1 },
+    { "4.999.9", "5.0", -1 },
+    { "5.0", "4.999.9", 1 },
+    { "20101121", "20101121", 0 },
+    { "20101121", "20101122", -1 },
+    { "20101122", "20101121", 1 },
+    { "2_0", "2_0", 0 },
+    { "2.0", "2_0", 0 },
+    { "2_0", "2.0", 0 },
+    { "a", "a", 0 },
+    { "a+", "a+", 0 },
+    { "a+", "a_", 0 },
+    { "a_", "a+", 0 },
+    { "+a", "+a", 0 },
+    { "+a", "_a", 0 },
+    { "_a", "+a", 0 },
+    { "+_", "+_", 0 },
+    { "_+", "+_", 0 },
+    { "_+", "_+", 0 },
+    { "+", "_", 0 },
+    { "_", "+", 0 },
+    { "1.0~rc1", "1.0~rc1", 0 },
+    { "1.0~rc1", "1.0", -1 },
+    { "1.0", "1.0~rc1", 1 },
+    { "1.0~rc1", "1.0~rc2", -1 },
+    { "1.0~rc2", "1.0~rc1", 1 },
+    { "1.0~rc1~git123", "1.0~rc1~git123", 0 },
+    { "1.0~rc1~git123", "1.0~rc1", -1 },
+    { "1.0~rc1", "1.0~rc1~git123", 1 },
+    { "1.0^", "1.0^", 0 },
+    { "1.0^", "1.0", 1 },
+    { "1.0", "1.0^", -1 },
+    { "1.0^git1", "1.0^git1", 0 },
+    { "1.0^git1", "1.0", 1 },
+    { "1.0", "1.0^git1", -1 },
+    { "1.0^git1", "1.0^git2", -1 },
+    { "1.0^git2", "1.0^git1", 1 },
+    { "1.0^git1", "1.01", -1 },
+    { "1.01", "1.0^git1", 1 },
+    { "1.0^20160101", "1.0^20160101", 0 },
+    { "1.0^20160101", "1.0.1", -1 },
+    { "1.0.1", "1.0^20160101", 1 },
+    { "1.0^20160101^git1", "1.0^20160101^git1", 0 },
+    { "1.0^20160102", "1.0^20160101^git1", 1 },
+    { "1.0^20160101^git1", "1.0^20160102", -1 },
+    { "1.0~rc1^git1", "1.0~rc1^git1", 0 },
+    { "1.0~rc1^git1", "1.0~rc1", 1 },
+    { "1.0~rc1", "1.0~rc1^git1", -1 },
+    { "1.0^git1~pre", "1.0^git1~pre", 0 },
+    { "1.0^git1", "1.0^git1~pre", 1 },
+    { "1.0^git1~pre", "1.0^git1", -1 },
+    /* Leading zeros and alpha against numeric segments */
+    { "00", "0", 0 },
+    { "1.010", "1.10", 0 },
+    { "1.0a", "1.0.0", -1 },
+    { "1.a", "1.1", -1 },
+    { "1.1", "1.a", 1 },
+};
+
+typedef struct {
+    const char *epoch1, *version1, *release1;
+    const char *epoch2, *version2, *release2;
+    int result;
+} EvrCase;
+
+static const EvrCase evrs[] = {
+    { NULL, "1.0", "1", "0", "1.0", "1", 0 },
+    { "", "1.0", "1", "0", "1.0", "1", 0 },
+    { "1", "1.0", "1", "0", "2.0", "1", 1 },
+    { "0", "2.0", "1", "1", "1.0", "1", -1 },
+    { "2", "1.0", "1", "10", "1.0", "1", -1 },
+    { "01", "1.0", "1", "1", "1.0", "1", 0 },
+    { "0", "1.0", "1.fc12", "0", "1.0", "1.fc9", 1 },
+    { "0", "1.0", "2", "0", "1.0", "10", -1 },
+    { "0", "1.0~rc1", "5", "0", "1.0", "1", -1 },
+    { "0", "1.0", "1~beta", "0", "1.0", "1", -1 },
+    { "0", "1.0", "1^post", "0", "1.0", "1", 1 },
+};
+
+static int
+sign (int n)
+{
+    return (n > 0) - (n < 0);
+}
+
+/* -1, 0 or 1 as memcmp () orders the two keys, a prefix first */
+static int
+key_cmp (GString *a, GString *b)
+{
+    int rc;
+
+    rc = memcmp (a->str, b->str, MIN (a->len, b->len));
+    if (rc == 0)
+        rc = (int) a->len - (int) b->len;
+
+    return sign (rc);
+}
+
+int
+main (void)
+{
+    GString *key1 = g_string_new (NULL);
+    GString *key2 = g_string_new (NULL);
+    int failed = 0;
+    int rc;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (versions); i++) {
+        const VersionCase *c = &versions[i];
+
+        rc = sign (yum_rpmvercmp (c->a, c->b));
+        if (rc != c->result) {
+            printf ("rpmvercmp (%s, %s) = %d, rpm says %d\n",
+                    c->a, c->b, rc, c->result);
+            failed++;
+        }
+
+        yum_evr_sort_key ("0", c->a, "1", key1);
+        yum_evr_sort_key ("0", c->b, "1", key2);
+        rc = key_cmp (key1, key2);
+        if (rc != c->result) {
+            printf ("sort key of %s against %s = %d, rpm says %d\n",
+                    c->a, c->b, rc, c->result);
+            failed++;
+        }
+    }
+
+    for (i = 0; i < G_N_ELEMENTS (evrs); i++) {
+        const EvrCase *c = &evrs[i];
+
+        rc = sign (yum_evr_cmp (c->epoch1, c->version1, c->release1,
+                                c->epoch2, c->version2, c->release2));
+        if (rc != c->result) {
+            printf ("evr_cmp (%s:%s-%s, %s:%s-%s) = %d, rpm says %d\n",
+                    c->epoch1, c->version1, c->release1,
+                    c->epoch2, c->version2, c->release2, rc, c->result);
+            failed++;
+        }
+
+        yum_evr_sort_key (c->epoch1, c->version1, c->release1, key1);
+        yum_evr_sort_key (c->epoch2, c->version2, c->release2, key2);
+        rc = key_cmp (key1, key2);
+        if (rc != c->result) {
+            printf ("sort key of %s:%s-%s against %s:%s-%s = %d,"
+                    " rpm says %d\n",
+                    c->epoch1, c->version1, c->release1,
+                    c->epoch2, c->version2, c->release2, rc, c->result);
+            failed++;
+        }
+    }
+
+    g_string_free (key1, TRUE);
+    g_string_free (key2, TRUE);
+
+    printf ("%d of %u checks failed\n", failed,
+            (guint) (G_N_ELEMENTS (versions) + G_N_ELEMENTS (evrs)) * 2);
+
+    return failed ? 1 : 0;
+}
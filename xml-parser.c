@@ -26,6 +26,10 @@
 
 #define PACKAGE_FIELD_SIZE 1024
 
+/*  Packages with more files than this are handed to the chunk callback of
+ * yum_xml_parse_filelists_chunked () this many files at a time. */
+#define YMP_CONFIG_FILELIST_CHUNK 16384
+
 GQuark
 yum_parser_error_quark (void)
 {
@@ -634,8 +638,32 @@ typedef struct {
     FilelistSAXContextState state;
 
     PackageFile *current_file;
+
+    /*  File names of the current package, kept apart from its chunk so
+     * they can go once a chunk of them is written */
+    GStringChunk *file_names;
+    guint n_files;
+    PackageFn chunk_fn;
 } FilelistSAXContext;
 
+/* Hands the files read so far to chunk_fn and forgets them */
+static void
+filelist_parser_chunk_done (FilelistSAXContext *ctx)
+{
+    SAXContext *sctx = &ctx->sctx;
+    Package *p = sctx->current_package;
+
+    if (!*sctx->error)
+        ctx->chunk_fn (p, sctx->user_data);
+
+    g_slist_foreach (p->files, (GFunc) g_free, NULL);
+    g_slist_free (p->files);
+    p->files = NULL;
+
+    g_string_chunk_clear (ctx->file_names);
+    ctx->n_files = 0;
+}
+
 static void
 filelist_parser_toplevel_start (FilelistSAXContext *ctx,
                                 const char *name,
@@ -748,12 +776,15 @@ filelist_parser_package_end (FilelistSAXContext *ctx, const char *name)
             ctx->current_file = NULL;
         }
 
+        g_string_chunk_clear (ctx->file_names);
+        ctx->n_files = 0;
+
         ctx->state = FILELIST_PARSER_TOPLEVEL;
     }
 
     else if (!strcmp (name, "file")) {
         PackageFile *file = ctx->current_file;
-        file->name = g_string_chunk_insert_len (p->chunk,
+        file->name = g_string_chunk_insert_len (ctx->file_names,
                                                 sctx->text_buffer->str,
                                                 sctx->text_buffer->len);
         if (!file->type)
@@ -761,6 +792,9 @@ filelist_parser_package_end (FilelistSAXContext *ctx, const char *name)
 
         p->files = g_slist_prepend (p->files, file);
         ctx->current_file = NULL;
+
+        if (ctx->chunk_fn && ++ctx->n_files == YMP_CONFIG_FILELIST_CHUNK)
+            filelist_parser_chunk_done (ctx);
     }
 }
 
@@ -808,12 +842,17 @@ static xmlSAXHandler filelist_sax_handler = {
     sax_error,      /* fatalError */
 };
 
+/*  Like yum_xml_parse_filelists (), but packages with a lot of files are
+ * handed to chunk_callback every YMP_CONFIG_FILELIST_CHUNK files, and
+ * only the files read after the last chunk are left for package_callback.
+ * Memory use stays bounded however many files a package has. */
 void
-yum_xml_parse_filelists (const char *filename,
-                         CountFn count_callback,
-                         PackageFn package_callback,
-                         gpointer user_data,
-                         GError **err)
+yum_xml_parse_filelists_chunked (const char *filename,
+                                 CountFn count_callback,
+                                 PackageFn package_callback,
+                                 PackageFn chunk_callback,
+                                 gpointer user_data,
+                                 GError **err)
 {
     FilelistSAXContext ctx;
     SAXContext *sctx = &ctx.sctx;
@@ -822,7 +861,10 @@ yum_xml_parse_filelists (const char *filename,
 
     ctx.state = FILELIST_PARSER_TOPLEVEL;
     ctx.current_file = NULL;
-    
+    ctx.file_names = g_string_chunk_new (PACKAGE_FIELD_SIZE * 16);
+    ctx.n_files = 0;
+    ctx.chunk_fn = chunk_callback;
+
     sax_context_init(sctx, "filelists.xml", count_callback, package_callback,
                      user_data, err);
 
@@ -837,9 +879,21 @@ yum_xml_parse_filelists (const char *filename,
     if (ctx.current_file)
         g_free (ctx.current_file);
 
+    g_string_chunk_free (ctx.file_names);
     g_string_free (sctx->text_buffer, TRUE);
 }
 
+void
+yum_xml_parse_filelists (const char *filename,
+                         CountFn count_callback,
+                         PackageFn package_callback,
+                         gpointer user_data,
+                         GError **err)
+{
+    yum_xml_parse_filelists_chunked (filename, count_callback,
+                                     package_callback, NULL, user_data, err);
+}
+
 /*****************************************************************************/
 
 typedef enum {
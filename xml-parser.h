@@ -39,6 +39,14 @@ yum_xml_parse_filelists (const char *filename,
                          gpointer user_data,
                          GError **err);
 
+void
+yum_xml_parse_filelists_chunked (const char *filename,
+                                 CountFn count_callback,
+                                 PackageFn package_callback,
+                                 PackageFn chunk_callback,
+                                 gpointer user_data,
+                                 GError **err);
+
 void yum_xml_parse_other (const char *filename,
                           CountFn count_callback,
                           PackageFn package_callback,
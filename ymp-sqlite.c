@@ -0,0 +1,447 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/*  Built with SQLITE_CORE into _sqlitecache, which calls SQLite directly,
+ * and without it as ymp_sqlite.so, which goes through the routines of
+ * the connection loading it. */
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT1
+
+#include <string.h>
+#include <glib.h>
+#include "evr.h"
+#include "filenames.h"
+#include "ymp-sqlite.h"
+
+/* Room for the decoded filenames of most directories */
+#define FILENAMES_SIZE 2048
+
+/*  The '/' joined filenames of a filelist row, decoded into out in the
+ * front_code_files layout. NULL if value is NULL or can not be decoded. */
+static const char *
+filenames_text (sqlite3_value *value, GString *out, gsize *len)
+{
+    switch (sqlite3_value_type (value)) {
+    case SQLITE_NULL:
+        return NULL;
+    case SQLITE_BLOB:
+        if (!yum_filenames_decode (sqlite3_value_blob (value),
+                                   sqlite3_value_bytes (value), out))
+            return NULL;
+        *len = out->len;
+        return out->str;
+    default:
+        *len = sqlite3_value_bytes (value);
+        return (const char *) sqlite3_value_text (value);
+    }
+}
+
+/* ymp_filenames () for the views of the front_code_files layout */
+static void
+sqlite_filenames (sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    GString *names;
+    gsize len;
+
+    if (sqlite3_value_type (argv[0]) != SQLITE_BLOB) {
+        sqlite3_result_value (ctx, argv[0]);
+        return;
+    }
+
+    names = g_string_sized_new (FILENAMES_SIZE);
+    if (yum_filenames_decode (sqlite3_value_blob (argv[0]),
+                              sqlite3_value_bytes (argv[0]), names)) {
+        len = names->len;
+        sqlite3_result_text (ctx, g_string_free (names, FALSE), len, g_free);
+    } else {
+        sqlite3_result_error (ctx, "Can not decode filenames", -1);
+        g_string_free (names, TRUE);
+    }
+}
+
+/* ymp_evr_key (epoch, version, release), see yum_evr_sort_key () */
+static void
+sqlite_evr_key (sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    GString *key;
+
+    key = g_string_sized_new (64);
+    yum_evr_sort_key ((const char *) sqlite3_value_text (argv[0]),
+                      (const char *) sqlite3_value_text (argv[1]),
+                      (const char *) sqlite3_value_text (argv[2]),
+                      key);
+    sqlite3_result_blob (ctx, key->str, key->len, SQLITE_TRANSIENT);
+    g_string_free (key, TRUE);
+}
+
+/* rpmvercmp (a, b), NULL if either is */
+static void
+sqlite_rpmvercmp (sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    const char *a = (const char *) sqlite3_value_text (argv[0]);
+    const char *b = (const char *) sqlite3_value_text (argv[1]);
+
+    if (a && b)
+        sqlite3_result_int (ctx, yum_rpmvercmp (a, b));
+    else
+        sqlite3_result_null (ctx);
+}
+
+/*  evr_cmp (e1, v1, r1, e2, v2, r2), where NULL epochs are 0 and a NULL
+ * release matches any, like the columns of the dependency tables. */
+static void
+sqlite_evr_cmp (sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    const char *evr[6];
+    int i;
+
+    for (i = 0; i < 6; i++)
+        evr[i] = (const char *) sqlite3_value_text (argv[i]);
+
+    sqlite3_result_int (ctx, yum_evr_cmp (evr[0], evr[1], evr[2],
+                                          evr[3], evr[4], evr[5]));
+}
+
+/*  filelist_contains (dirname, filenames, path): whether path is one of
+ * the files of a filelist row, without splitting it into rows. NULL if
+ * any argument is. */
+static void
+sqlite_filelist_contains (sqlite3_context *ctx,
+                          int argc,
+                          sqlite3_value **argv)
+{
+    const char *dirname;
+    const char *path;
+    const char *name;
+    const char *names;
+    GString *decoded;
+    gsize len;
+    gboolean found;
+
+    dirname = (const char *) sqlite3_value_text (argv[0]);
+    path = (const char *) sqlite3_value_text (argv[2]);
+    if (!dirname || !path || sqlite3_value_type (argv[1]) == SQLITE_NULL) {
+        sqlite3_result_null (ctx);
+        return;
+    }
+
+    name = yum_filenames_path_name (dirname, path);
+    if (!name) {
+        sqlite3_result_int (ctx, 0);
+        return;
+    }
+
+    decoded = g_string_sized_new (FILENAMES_SIZE);
+    names = filenames_text (argv[1], decoded, &len);
+    if (!names) {
+        sqlite3_result_error (ctx, "Can not decode filenames", -1);
+        g_string_free (decoded, TRUE);
+        return;
+    }
+
+    found = yum_filenames_contain (names, len, name, strlen (name));
+    g_string_free (decoded, TRUE);
+
+    sqlite3_result_int (ctx, found);
+}
+
+/*  filelist_expand (dirname, filenames[, filetypes]), a table-valued
+ * function with a (path, type) row per file of a filelist row, types
+ * named like the primary files table names them. */
+
+#define EXPAND_PATH      0
+#define EXPAND_TYPE      1
+#define EXPAND_DIRNAME   2
+#define EXPAND_FILENAMES 3
+#define EXPAND_FILETYPES 4
+
+typedef struct {
+    sqlite3_vtab_cursor base;
+    GString *names;             /* The filenames, decoded */
+    GString *path;              /* The directory, then the current name */
+    char *types;                /* The filetypes letters, or NULL */
+    gsize dir_len;
+    YumFilenamesIter iter;      /* Over names */
+    sqlite3_int64 rowid;        /* Index of the current name */
+    gboolean eof;
+} ExpandCursor;
+
+static int
+expand_connect (sqlite3 *db,
+                void *data,
+                int argc,
+                const char *const *argv,
+                sqlite3_vtab **vtab,
+                char **err)
+{
+    int rc;
+
+    rc = sqlite3_declare_vtab (db, "CREATE TABLE x (path TEXT, type TEXT,"
+                               "  dirname HIDDEN, filenames HIDDEN,"
+                               "  filetypes HIDDEN)");
+    if (rc != SQLITE_OK)
+        return rc;
+
+    *vtab = sqlite3_malloc (sizeof (sqlite3_vtab));
+    if (!*vtab)
+        return SQLITE_NOMEM;
+    memset (*vtab, 0, sizeof (sqlite3_vtab));
+
+    return SQLITE_OK;
+}
+
+static int
+expand_disconnect (sqlite3_vtab *vtab)
+{
+    sqlite3_free (vtab);
+    return SQLITE_OK;
+}
+
+/*  dirname and filenames have to be given, filetypes may be. Plans that
+ * would read them from a table not joined yet are refused. */
+static int
+expand_best_index (sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+    int args[3] = { -1, -1, -1 };
+    gboolean unusable = FALSE;
+    int column;
+    int n = 0;
+    int i;
+
+    for (i = 0; i < info->nConstraint; i++) {
+        column = info->aConstraint[i].iColumn;
+        if (column < EXPAND_DIRNAME ||
+            info->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ)
+            continue;
+        if (!info->aConstraint[i].usable)
+            unusable = TRUE;
+        else
+            args[column - EXPAND_DIRNAME] = i;
+    }
+
+    if (args[0] < 0 || args[1] < 0) {
+        if (unusable)
+            return SQLITE_CONSTRAINT;
+        sqlite3_free (vtab->zErrMsg);
+        vtab->zErrMsg = sqlite3_mprintf ("filelist_expand () needs a dirname"
+                                         " and filenames");
+        return SQLITE_ERROR;
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (args[i] < 0)
+            continue;
+        info->aConstraintUsage[args[i]].argvIndex = ++n;
+        info->aConstraintUsage[args[i]].omit = 1;
+    }
+    info->idxNum = args[2] >= 0;
+    info->estimatedCost = 10;
+
+    return SQLITE_OK;
+}
+
+static int
+expand_open (sqlite3_vtab *vtab, sqlite3_vtab_cursor **cursor)
+{
+    ExpandCursor *c;
+
+    c = g_new0 (ExpandCursor, 1);
+    c->names = g_string_sized_new (FILENAMES_SIZE);
+    c->path = g_string_sized_new (256);
+    c->eof = TRUE;
+    *cursor = &c->base;
+
+    return SQLITE_OK;
+}
+
+static int
+expand_close (sqlite3_vtab_cursor *cursor)
+{
+    ExpandCursor *c = (ExpandCursor *) cursor;
+
+    g_string_free (c->names, TRUE);
+    g_string_free (c->path, TRUE);
+    g_free (c->types);
+    g_free (c);
+
+    return SQLITE_OK;
+}
+
+static int
+expand_next (sqlite3_vtab_cursor *cursor)
+{
+    ExpandCursor *c = (ExpandCursor *) cursor;
+    const char *name;
+    gsize len;
+
+    if (!yum_filenames_iter_next (&c->iter, &name, &len)) {
+        c->eof = TRUE;
+        return SQLITE_OK;
+    }
+
+    g_string_truncate (c->path, c->dir_len);
+    g_string_append_len (c->path, name, len);
+    c->rowid++;
+
+    return SQLITE_OK;
+}
+
+static int
+expand_filter (sqlite3_vtab_cursor *cursor,
+               int idx,
+               const char *idx_str,
+               int argc,
+               sqlite3_value **argv)
+{
+    ExpandCursor *c = (ExpandCursor *) cursor;
+    const char *dirname;
+    const char *names;
+    const char *types;
+    gsize len;
+
+    g_string_truncate (c->names, 0);
+    g_free (c->types);
+    c->types = NULL;
+    c->rowid = -1;
+    c->eof = TRUE;
+
+    dirname = (const char *) sqlite3_value_text (argv[0]);
+    if (!dirname || sqlite3_value_type (argv[1]) == SQLITE_NULL)
+        return SQLITE_OK;
+
+    names = filenames_text (argv[1], c->names, &len);
+    if (!names) {
+        sqlite3_free (cursor->pVtab->zErrMsg);
+        cursor->pVtab->zErrMsg = sqlite3_mprintf ("Can not decode"
+                                                  " filenames");
+        return SQLITE_ERROR;
+    }
+    if (names != c->names->str)
+        g_string_append_len (c->names, names, len);
+    yum_filenames_iter_init (&c->iter, c->names->str, c->names->len);
+
+    if (idx) {
+        types = (const char *) sqlite3_value_text (argv[2]);
+        c->types = g_strdup (types);
+    }
+
+    g_string_assign (c->path, dirname);
+    if (c->path->len && c->path->str[c->path->len - 1] != '/')
+        g_string_append_c (c->path, '/');
+    c->dir_len = c->path->len;
+    c->eof = FALSE;
+
+    return expand_next (cursor);
+}
+
+static int
+expand_eof (sqlite3_vtab_cursor *cursor)
+{
+    return ((ExpandCursor *) cursor)->eof;
+}
+
+static int
+expand_column (sqlite3_vtab_cursor *cursor, sqlite3_context *ctx, int i)
+{
+    ExpandCursor *c = (ExpandCursor *) cursor;
+    char type = 'f';
+
+    switch (i) {
+    case EXPAND_PATH:
+        sqlite3_result_text (ctx, c->path->str, c->path->len,
+                             SQLITE_TRANSIENT);
+        break;
+    case EXPAND_TYPE:
+        if (c->types && c->rowid < (sqlite3_int64) strlen (c->types))
+            type = c->types[c->rowid];
+        sqlite3_result_text (ctx, type == 'd' ? "dir" :
+                             type == 'g' ? "ghost" : "file", -1,
+                             SQLITE_STATIC);
+        break;
+    default:
+        sqlite3_result_null (ctx);
+        break;
+    }
+
+    return SQLITE_OK;
+}
+
+static int
+expand_rowid (sqlite3_vtab_cursor *cursor, sqlite3_int64 *rowid)
+{
+    *rowid = ((ExpandCursor *) cursor)->rowid;
+    return SQLITE_OK;
+}
+
+/* No xCreate, so it only exists as the table-valued function */
+static sqlite3_module expand_module = {
+    0,                          /* iVersion */
+    NULL,                       /* xCreate */
+    expand_connect,             /* xConnect */
+    expand_best_index,          /* xBestIndex */
+    expand_disconnect,          /* xDisconnect */
+    NULL,                       /* xDestroy */
+    expand_open,                /* xOpen */
+    expand_close,               /* xClose */
+    expand_filter,              /* xFilter */
+    expand_next,                /* xNext */
+    expand_eof,                 /* xEof */
+    expand_column,              /* xColumn */
+    expand_rowid,               /* xRowid */
+};
+
+int
+ymp_sqlite_register (sqlite3 *db)
+{
+    static const struct {
+        const char *name;
+        int n_args;
+        void (*fn) (sqlite3_context *, int, sqlite3_value **);
+    } functions[] = {
+        { "ymp_filenames", 1, sqlite_filenames },
+        { "ymp_evr_key", 3, sqlite_evr_key },
+        { "rpmvercmp", 2, sqlite_rpmvercmp },
+        { "evr_cmp", 6, sqlite_evr_cmp },
+        { "filelist_contains", 3, sqlite_filelist_contains },
+        { NULL, 0, NULL }
+    };
+    int rc = SQLITE_OK;
+    int i;
+
+    for (i = 0; rc == SQLITE_OK && functions[i].name; i++)
+        rc = sqlite3_create_function (db, functions[i].name,
+                                      functions[i].n_args, SQLITE_UTF8,
+                                      NULL, functions[i].fn, NULL, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_create_module (db, "filelist_expand", &expand_module,
+                                    NULL);
+
+    return rc;
+}
+
+#ifndef SQLITE_CORE
+/*  The entry point SQLite looks for in ymp_sqlite.so, named after the
+ * letters of the file name. */
+int
+sqlite3_ympsqlite_init (sqlite3 *db,
+                        char **err,
+                        const sqlite3_api_routines *api)
+{
+    SQLITE_EXTENSION_INIT2 (api);
+    return ymp_sqlite_register (db);
+}
+#endif
@@ -0,0 +1,38 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#ifndef __YMP_SQLITE_H__
+#define __YMP_SQLITE_H__
+
+#include <sqlite3.h>
+
+/*  The SQL functions of the caches, built into _sqlitecache and as the
+ * loadable extension ymp_sqlite.so:
+ *
+ *   ymp_filenames (filenames)      filelist filenames as '/' joined text
+ *   ymp_evr_key (e, v, r)          see yum_evr_sort_key ()
+ *   rpmvercmp (a, b)               -1, 0 or 1, see yum_rpmvercmp ()
+ *   evr_cmp (e1, v1, r1, e2, v2, r2)
+ *                                  -1, 0 or 1, see yum_evr_cmp ()
+ *   filelist_contains (dirname, filenames, path)
+ *                                  whether a filelist row lists path
+ *   filelist_expand (dirname, filenames[, filetypes])
+ *                                  a table of the row's (path, type)
+ */
+int ymp_sqlite_register (sqlite3 *db);
+
+#endif /* __YMP_SQLITE_H__ */